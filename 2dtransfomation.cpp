@@ -12,21 +12,69 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <vector>
+
+#include "frame_capture.h"
+#include "frame_pacing.h"
+#include "frame_profiler.h"
+#include "input.h"
+#include "offscreen.h"
+#include "redraw_tracker.h"
+#include "render_options.h"
+#include "shader_cache.h"
+#include "stream_buffer.h"
+#include "transform2d.h"
 
 using namespace std;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void window_refresh_callback(GLFWwindow* window);
+void processInput(float seconds, bool firstStep);
+void writeRipple(float* vertices, int segments, float time);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
-float rotateAngle = 0.0;
-float translate_X = 0.0;
-float translate_Y = 0.0;
-float scale_X = 1.0;
-float scale_Y = 1.0;
+
+// the simulation moves simulatedTransform in fixed steps, remembering the state before
+// the last step in previousTransform; triangleTransform is drawn, blended between the two
+Transform2D simulatedTransform;
+Transform2D previousTransform;
+Transform2D triangleTransform;
+
+// what the keys do: actions, the keys bound to them, and how fast each one moves the
+// triangle per second
+enum Action { Quit, RotateLeft, RotateRight, MoveUp, MoveDown, MoveRight, MoveLeft, WidenX, NarrowX, StretchY, ShrinkY };
+
+const struct { int key; Action action; } keyBindings[] = {
+    { GLFW_KEY_ESCAPE, Quit },
+    { GLFW_KEY_R, RotateLeft }, { GLFW_KEY_T, RotateRight },
+    { GLFW_KEY_W, MoveUp }, { GLFW_KEY_S, MoveDown }, { GLFW_KEY_D, MoveRight }, { GLFW_KEY_A, MoveLeft },
+    { GLFW_KEY_X, WidenX }, { GLFW_KEY_C, NarrowX }, { GLFW_KEY_Y, StretchY }, { GLFW_KEY_U, ShrinkY },
+};
+
+// degrees of rotation, translation and scale, per second, indexed by Action
+const struct { float rotate, translateX, translateY, scaleX, scaleY; } actionRates[] = {
+    { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f },       // Quit
+    { 60.0f, 0.0f, 0.0f, 0.0f, 0.0f },      // RotateLeft
+    { -60.0f, 0.0f, 0.0f, 0.0f, 0.0f },     // RotateRight
+    { 0.0f, 0.0f, 0.6f, 0.0f, 0.0f },       // MoveUp
+    { 0.0f, 0.0f, -0.6f, 0.0f, 0.0f },      // MoveDown
+    { 0.0f, 0.6f, 0.0f, 0.0f, 0.0f },       // MoveRight
+    { 0.0f, -0.6f, 0.0f, 0.0f, 0.0f },      // MoveLeft
+    { 0.0f, 0.0f, 0.0f, 0.6f, 0.0f },       // WidenX
+    { 0.0f, 0.0f, 0.0f, -0.6f, 0.0f },      // NarrowX
+    { 0.0f, 0.0f, 0.0f, 0.0f, 0.6f },       // StretchY
+    { 0.0f, 0.0f, 0.0f, 0.0f, -0.6f },      // ShrinkY
+};
+
+InputSystem input;
+
+// with --on-demand a frame is only drawn after something marked it here
+RedrawTracker redraw;
 
 const char* vertexShaderSource = "#version 330 core\n"
 "layout (location = 0) in vec3 aPos;\n"
@@ -42,8 +90,10 @@ const char* fragmentShaderSource = "#version 330 core\n"
 "   FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
 "}\n\0";
 
-int main()
+int main(int argc, char** argv)
 {
+    RenderOptions options = parseRenderOptions(argc, argv);
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -54,6 +104,8 @@ int main()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+    if (options.headless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     // glfw window creation
     // --------------------
@@ -66,6 +118,12 @@ int main()
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+
+    // key events arrive through a callback and are turned into actions by the binding table
+    input.attach(window);
+    for (const auto& binding : keyBindings)
+        input.bind(binding.key, binding.action);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -75,46 +133,41 @@ int main()
         return -1;
     }
 
+    // headless: render into an offscreen framebuffer, the invisible window only provides the context
+    // -----------------------------------------------------------------------------------------------
+    OffscreenTarget offscreen;
+    if (options.headless)
+    {
+        if (!offscreen.create(SCR_WIDTH, SCR_HEIGHT))
+        {
+            std::cout << "Failed to create offscreen framebuffer" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        offscreen.bind();
+    }
+
 
     // build and compile our shader program
     // ------------------------------------
-    // vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-    // fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    // linked programs are kept as driver binaries in shader_cache/, so only the first
+    // run on a machine pays for compiling and linking
+    auto shaderStart = std::chrono::steady_clock::now();
+    ShaderCache shaderCache;
+    shaderCache.enableBinaryCache("shader_cache");
+    unsigned int shaderProgram = shaderCache.getProgram(vertexShaderSource, fragmentShaderSource);
+    if (shaderProgram == 0)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-    // link shaders
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        glfwTerminate();
+        return -1;
     }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    double shaderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
+    std::cout << "Shaders ready in " << shaderMs << " ms (" << shaderCache.binaryLoads() << " loaded from binary cache, "
+        << shaderCache.programLinks() << " compiled)" << std::endl;
+
+    // uniform locations are fixed once the program is linked
+    int transformLoc = glGetUniformLocation(shaderProgram, "transform");
+    unsigned int uploadedTransformVersion = 0;
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -169,65 +222,245 @@ int main()
     glBindVertexArray(0);
 
 
+    // dynamic geometry: a rippling fan whose vertices are rewritten every frame into a
+    // streaming buffer, so the CPU never waits on, or has the driver reallocate, what the GPU is drawing
+    // -------------------------------------------------------------------------------------------------
+    const int rippleSegments = 64;
+    const int rippleVertexCount = rippleSegments + 2;
+    const size_t rippleStride = 3 * sizeof(float);
+    StreamBuffer streamBuffer;
+    unsigned int streamVAO = 0;
+    // a region holds a whole number of vertices, so every frame's offset is one too
+    if (options.dynamicGeometry && !streamBuffer.create(rippleVertexCount * rippleStride))
+    {
+        std::cout << "Failed to create streaming vertex buffer, drawing the static triangle" << std::endl;
+        streamBuffer.destroy();
+        options.dynamicGeometry = false;
+    }
+    if (options.dynamicGeometry)
+    {
+        glGenVertexArrays(1, &streamVAO);
+        glBindVertexArray(streamVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, streamBuffer.buffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, rippleStride, (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        std::cout << "Streaming vertices through " << (streamBuffer.persistent() ? "a persistently mapped buffer" : "glBufferSubData")
+            << std::endl;
+    }
+
     // uncomment this call to draw in wireframe polygons.
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // frame recording: readbacks go through a ring of PBOs so the loop never waits on the GPU
+    // ----------------------------------------------------------------------------------------
+    FrameCapture frameCapture;
+    if (!options.captureDirectory.empty())
+    {
+        int captureWidth = SCR_WIDTH, captureHeight = SCR_HEIGHT;
+        if (!options.headless)
+            glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+        frameCapture.start(options.captureDirectory.c_str(), captureWidth, captureHeight);
+    }
+
+    // profiling: optional per-frame timings of input, matrix building, drawing and presenting
+    // ----------------------------------------------------------------------------------------
+    FrameProfiler profiler;
+    FrameProfiler* activeProfiler = NULL;
+    int inputSection = 0, matrixSection = 0, drawSection = 0, swapSection = 0;
+    if (!options.profilePath.empty())
+    {
+        activeProfiler = &profiler;
+        inputSection = profiler.addSection("input", false);
+        matrixSection = profiler.addSection("matrices", false);
+        drawSection = profiler.addSection("draw", true);
+        swapSection = profiler.addSection("swap", false);
+    }
+
+    // frame pacing: vsync, uncapped or a target rate; motion follows the fixed-step
+    // simulation, so it is the same at any of them
+    // ---------------------------------------------------------------------------------
+    FramePacer pacer;
+    pacer.start(options.vsync && !options.headless, options.targetFps);
+    FixedTimestep timestep(1.0 / options.simulationRate);
+
     // render loop
     // -----------
+    int frame = 0;
+    auto renderStart = std::chrono::steady_clock::now();
+    auto frameStart = renderStart;
     while (!glfwWindowShouldClose(window))
     {
-        // input
-        // -----
-        processInput(window);
+        pacer.wait();
+        if (activeProfiler)
+            activeProfiler->beginFrame();
+
+        // input and simulation: as many fixed steps as the time since the last frame holds
+        // ---------------------------------------------------------------------------------
+        {
+            ProfileScope scope(activeProfiler, inputSection);
+            auto now = std::chrono::steady_clock::now();
+            int steps = timestep.advance(std::chrono::duration<double>(now - frameStart).count());
+            frameStart = now;
+
+            // key events wait in the queue until a step consumes them, so a tap between two
+            // steps still moves the triangle, by exactly one step however many the frame holds
+            if (steps > 0)
+            {
+                input.update();
+                if (input.pressed(Quit))
+                    glfwSetWindowShouldClose(window, true);
+            }
+            for (int step = 0; step < steps; step++)
+            {
+                previousTransform = simulatedTransform;
+                processInput((float)timestep.step(), step == 0);
+            }
+        }
+
+        // create transformations: the drawn state lies between the last two steps; the
+        // model matrix is only recomposed when that moved
+        const glm::mat4* modelMatrix;
+        {
+            ProfileScope scope(activeProfiler, matrixSection);
+            triangleTransform.interpolate(previousTransform, simulatedTransform, timestep.alpha());
+            modelMatrix = &triangleTransform.matrix();
+        }
+
+        // on demand, only draw when the triangle moved, the ripple animates or the window
+        // needs repainting
+        if (options.dynamicGeometry || uploadedTransformVersion != triangleTransform.version())
+            redraw.markAll();
+        bool drawFrame = !options.renderOnDemand || redraw.dirty();
+        bool animating = options.dynamicGeometry || !input.activeActions().empty()
+            || previousTransform.version() != simulatedTransform.version();
 
         // render
         // ------
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // create transformations
-        /*glm::mat4 trans = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        trans = glm::translate(trans, glm::vec3(translate_X, translate_Y, 0.0f));
-        trans = glm::rotate(trans, glm:: radians(rotateAngle), glm::vec3(0.0f, 0.0f, 1.0f));
-        trans = glm::scale(trans,glm::vec3(scale_X, scale_Y, 1.0));*/
-        glm::mat4 translationMatrix;
-        glm::mat4 rotationMatrix;
-        glm::mat4 scaleMatrix;
-        glm::mat4 modelMatrix;
-        glm::mat4 identityMatrix = glm::mat4(1.0f);
-        translationMatrix = glm::translate(identityMatrix, glm::vec3(translate_X, translate_Y, 0.0f));
-        rotationMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle), glm::vec3(0.0f, 0.0f, 1.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(scale_X, scale_Y, 1.0f));
-        modelMatrix = translationMatrix * rotationMatrix * scaleMatrix;
-        //modelMatrix = rotationMatrix * scaleMatrix;
-
-        // get matrix's uniform location and set matrix
-        glUseProgram(shaderProgram);
-        unsigned int transformLoc = glGetUniformLocation(shaderProgram, "transform");
-        glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-
-        // draw our first triangle
-        glBindVertexArray(VAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
-        //glDrawArrays(GL_LINES, 0, 6);
-        //glDrawArrays(GL_LINE_STRIP, 0, 6);
-        //glDrawArrays(GL_LINE_LOOP, 0, 6);
-        //glDrawArrays(GL_TRIANGLES, 0, 6);
-        //glDrawArrays(GL_TRIANGLE_STRIP, 0, 6);
-        //glDrawArrays(GL_TRIANGLE_FAN, 0, 6);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-        // glBindVertexArray(0); // no need to unbind it every time
+        if (!drawFrame)
+            redraw.skipped();
+        else
+        {
+            ProfileScope scope(activeProfiler, drawSection);
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // set the matrix, unless the program already holds this version of it
+            glUseProgram(shaderProgram);
+            if (uploadedTransformVersion != triangleTransform.version())
+            {
+                glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(*modelMatrix));
+                uploadedTransformVersion = triangleTransform.version();
+            }
+
+            if (options.dynamicGeometry)
+            {
+                // the VAO points at the start of the buffer; this frame's vertices are
+                // reached through the first vertex instead of re-pointing the attribute
+                size_t offset = 0;
+                float* rippleVertices = (float*)streamBuffer.allocate(rippleVertexCount * rippleStride, rippleStride, offset);
+                writeRipple(rippleVertices, rippleSegments, (float)((timestep.totalSteps() + timestep.alpha()) * timestep.step()));
+                streamBuffer.commit();
+                glBindVertexArray(streamVAO);
+                glDrawArrays(GL_TRIANGLE_FAN, (GLint)(offset / rippleStride), rippleVertexCount);
+                streamBuffer.endFrame();
+            }
+            else
+            {
+                // draw our first triangle
+                glBindVertexArray(VAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
+                //glDrawArrays(GL_LINES, 0, 6);
+                //glDrawArrays(GL_LINE_STRIP, 0, 6);
+                //glDrawArrays(GL_LINE_LOOP, 0, 6);
+                //glDrawArrays(GL_TRIANGLES, 0, 6);
+                //glDrawArrays(GL_TRIANGLE_STRIP, 0, 6);
+                //glDrawArrays(GL_TRIANGLE_FAN, 0, 6);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                // glBindVertexArray(0); // no need to unbind it every time
+            }
+            redraw.rendered();
+        }
+
+        if (drawFrame && !options.captureDirectory.empty())
+            frameCapture.capture();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+        // headless runs have nothing to present and stop after the requested frame count.
+        // On demand, with nothing moving, sleep until an event arrives; the time asleep is
+        // not simulated, but the events get one step to act in.
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            ProfileScope scope(activeProfiler, swapSection);
+            if (!options.headless && drawFrame)
+                glfwSwapBuffers(window);
+            if (options.renderOnDemand && !options.headless && !animating)
+            {
+                glfwWaitEvents();
+                frameStart = std::chrono::steady_clock::now()
+                    - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timestep.step()));
+            }
+            else
+                glfwPollEvents();
+        }
+
+        if (activeProfiler)
+            activeProfiler->endFrame();
+
+        frame++;
+        if (options.headless && frame >= options.frameCount)
+            break;
+    }
+
+    double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+    std::cout << frame << " frames (" << frame / runSeconds << " per second) and " << timestep.totalSteps()
+        << " simulation steps (" << timestep.totalSteps() / runSeconds << " per second) in " << runSeconds << " s";
+    if (timestep.droppedSeconds() > 0.0)
+        std::cout << ", " << timestep.droppedSeconds() << " s of stalls skipped";
+    std::cout << std::endl;
+    if (options.renderOnDemand)
+        std::cout << "On demand: rendered " << redraw.framesRendered() << " frames, skipped " << redraw.framesSkipped()
+            << " with nothing to redraw" << std::endl;
+
+    if (activeProfiler)
+    {
+        profiler.finish();
+        profiler.report(std::cout);
+        if (!profiler.write(options.profilePath))
+            std::cout << "Failed to write " << options.profilePath << std::endl;
+    }
+
+    if (!options.captureDirectory.empty())
+    {
+        frameCapture.finish();
+        std::cout << "Captured " << frameCapture.framesWritten() << " frames to " << options.captureDirectory << std::endl;
+    }
+
+    if (options.headless)
+    {
+        std::vector<unsigned char> pixels;
+        offscreen.readPixels(pixels);
+        double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+        std::cout << "Rendered " << frame << " frames in " << renderMs << " ms (" << frame * 1000.0 / renderMs << " fps)" << std::endl;
+
+        if (!writePPM(options.outputPath.c_str(), offscreen.width, offscreen.height, pixels.data()))
+            std::cout << "Failed to write " << options.outputPath << std::endl;
+        offscreen.destroy();
+    }
+
+    if (options.dynamicGeometry)
+    {
+        std::cout << "Stream buffer: " << streamBuffer.waits() << " waits for the GPU, " << streamBuffer.orphans()
+            << " orphaned buffers in " << frame << " frames" << std::endl;
+        glDeleteVertexArrays(1, &streamVAO);
+        streamBuffer.destroy();
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
-    glDeleteProgram(shaderProgram);
+    shaderCache.destroy();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -235,51 +468,41 @@ int main()
     return 0;
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow* window)
+// apply the active actions for one simulation step of the given length; only actions that
+// are held or were just tapped are visited
+// ----------------------------------------------------------------------------------------
+void processInput(float seconds, bool firstStep)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
-    {
-        rotateAngle += 1;
-    }
-    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
-    {
-        rotateAngle -= 1;
-    }
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-    {
-        translate_Y += 0.01;
-    }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-    {
-        translate_Y -= 0.01;
-    }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    for (int action : input.activeActions())
     {
-        translate_X += 0.01;
+        // an action pressed and released again since the last update is a tap: it
+        // counts for the frame's first step only
+        if (!firstStep && !input.held(action))
+            continue;
+        const auto& rate = actionRates[action];
+        if (rate.rotate != 0.0f)
+            simulatedTransform.rotate(rate.rotate * seconds);
+        if (rate.translateX != 0.0f || rate.translateY != 0.0f)
+            simulatedTransform.translate(rate.translateX * seconds, rate.translateY * seconds);
+        if (rate.scaleX != 0.0f || rate.scaleY != 0.0f)
+            simulatedTransform.scale(rate.scaleX * seconds, rate.scaleY * seconds);
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-    {
-        translate_X -= 0.01;
-    }
-    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
-    {
-        scale_X += 0.01;
-    }
-    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
-    {
-        scale_X -= 0.01;
-    }
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
-    {
-        scale_Y += 0.01;
-    }
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS)
+}
+
+// a fan around the origin whose rim ripples with time: the center, then segments + 1 rim
+// vertices with the last one closing the fan
+// ---------------------------------------------------------------------------------------
+void writeRipple(float* vertices, int segments, float time)
+{
+    vertices[0] = vertices[1] = vertices[2] = 0.0f;
+    for (int i = 0; i <= segments; i++)
     {
-        scale_Y -= 0.01;
+        float angle = 6.2831853f * i / segments;
+        float radius = 0.5f + 0.05f * sin(6.0f * angle + 3.0f * time);
+        float* vertex = vertices + 3 * (i + 1);
+        vertex[0] = radius * cos(angle);
+        vertex[1] = radius * sin(angle);
+        vertex[2] = 0.0f;
     }
 }
 
@@ -290,4 +513,12 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    redraw.markAll();
+}
+
+// glfw: the window was uncovered or needs repainting for some other reason
+// -------------------------------------------------------------------------
+void window_refresh_callback(GLFWwindow* window)
+{
+    redraw.markAll();
 }
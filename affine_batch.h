@@ -0,0 +1,115 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Kernel selection happens at compile time, as in soft_raster.h: AVX2 when the compiler
+// targets it (/arch:AVX2, -mavx2), SSE2 on any x86-64 build, NEON on ARM, scalar otherwise
+// or when AFFINE_BATCH_SCALAR is defined
+#if !defined(AFFINE_BATCH_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define AFFINE_BATCH_AVX2 1
+#elif !defined(AFFINE_BATCH_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define AFFINE_BATCH_SSE2 1
+#elif !defined(AFFINE_BATCH_SCALAR) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define AFFINE_BATCH_NEON 1
+#endif
+
+// 2D affine transform, x' = a x + c y + tx and y' = b x + d y + ty: the part of a
+// translate * rotate * scale mat4 that moves points in the plane
+struct Affine2D
+{
+    float a = 1.0f, b = 0.0f;
+    float c = 0.0f, d = 1.0f;
+    float tx = 0.0f, ty = 0.0f;
+
+    static Affine2D fromMatrix(const glm::mat4& m)
+    {
+        Affine2D affine;
+        affine.a = m[0][0];
+        affine.b = m[0][1];
+        affine.c = m[1][0];
+        affine.d = m[1][1];
+        affine.tx = m[3][0];
+        affine.ty = m[3][1];
+        return affine;
+    }
+};
+
+inline const char* affineBatchKernel()
+{
+#if defined(AFFINE_BATCH_AVX2)
+    return "AVX2";
+#elif defined(AFFINE_BATCH_SSE2)
+    return "SSE2";
+#elif defined(AFFINE_BATCH_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+// Transform count points given as separate x and y arrays (structure of arrays) one at
+// a time; the reference the vector kernel is checked against. Output may alias input.
+inline void transformPointsScalar(const Affine2D& m, const float* xs, const float* ys, float* outX, float* outY, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float x = xs[i], y = ys[i];
+        outX[i] = m.a * x + m.c * y + m.tx;
+        outY[i] = m.b * x + m.d * y + m.ty;
+    }
+}
+
+// Transform count points given as separate x and y arrays, 8 (AVX2) or 4 (SSE2, NEON)
+// per step, the remainder one at a time. The arrays need no particular alignment and
+// the output may alias the input.
+inline void transformPoints(const Affine2D& m, const float* xs, const float* ys, float* outX, float* outY, size_t count)
+{
+    size_t i = 0;
+#if defined(AFFINE_BATCH_AVX2)
+    __m256 a = _mm256_set1_ps(m.a), b = _mm256_set1_ps(m.b), c = _mm256_set1_ps(m.c), d = _mm256_set1_ps(m.d);
+    __m256 tx = _mm256_set1_ps(m.tx), ty = _mm256_set1_ps(m.ty);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i);
+        _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, x), _mm256_mul_ps(c, y)), tx));
+        _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b, x), _mm256_mul_ps(d, y)), ty));
+    }
+#elif defined(AFFINE_BATCH_SSE2)
+    __m128 a = _mm_set1_ps(m.a), b = _mm_set1_ps(m.b), c = _mm_set1_ps(m.c), d = _mm_set1_ps(m.d);
+    __m128 tx = _mm_set1_ps(m.tx), ty = _mm_set1_ps(m.ty);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i);
+        _mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(c, y)), tx));
+        _mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(b, x), _mm_mul_ps(d, y)), ty));
+    }
+#elif defined(AFFINE_BATCH_NEON)
+    float32x4_t a = vdupq_n_f32(m.a), b = vdupq_n_f32(m.b), c = vdupq_n_f32(m.c), d = vdupq_n_f32(m.d);
+    float32x4_t tx = vdupq_n_f32(m.tx), ty = vdupq_n_f32(m.ty);
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t x = vld1q_f32(xs + i), y = vld1q_f32(ys + i);
+        vst1q_f32(outX + i, vaddq_f32(vaddq_f32(vmulq_f32(a, x), vmulq_f32(c, y)), tx));
+        vst1q_f32(outY + i, vaddq_f32(vaddq_f32(vmulq_f32(b, x), vmulq_f32(d, y)), ty));
+    }
+#endif
+    transformPointsScalar(m, xs + i, ys + i, outX + i, outY + i, count - i);
+}
+
+// Split x, y, z vertices, the layout of the scene batches, into x and y arrays
+inline void splitPositions(const float* xyz, size_t count, std::vector<float>& xs, std::vector<float>& ys)
+{
+    xs.resize(count);
+    ys.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        xs[i] = xyz[i * 3];
+        ys[i] = xyz[i * 3 + 1];
+    }
+}
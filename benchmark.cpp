@@ -0,0 +1,333 @@
+//
+//  benchmark.cpp
+//  Triangles per second of the software rasterizer (soft_raster.h) against the GL
+//  driver on the same random scene, and how many pixels of the two frames differ.
+//  Run with LIBGL_ALWAYS_SOFTWARE=1 to measure against Mesa llvmpipe.
+//  The software rasterizer runs with 1, 2, 4, ... up to --threads threads and reports
+//  the speedup of each over one thread.
+//  First, the scene's vertices are transformed on the CPU by per-vertex glm::mat4
+//  multiplies and by the batch kernel of affine_batch.h, in vertices per second.
+//
+//  benchmark [--triangles N] [--size PIXELS] [--frames N] [--threads N] [--wireframe] [--no-gl]
+//
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "affine_batch.h"
+#include "offscreen.h"
+#include "scene_batch.h"
+#include "shader_cache.h"
+#include "soft_raster.h"
+#include "transform2d.h"
+
+// settings
+const unsigned int SCR_WIDTH = 1920;
+const unsigned int SCR_HEIGHT = 1080;
+
+const char* vertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec3 aPos;\n"
+"void main()\n"
+"{\n"
+"   gl_Position = vec4(aPos, 1.0);\n"
+"}\0";
+
+const char* flatColorFragmentShaderSource = "#version 330 core\n"
+"out vec4 FragColor;\n"
+"uniform vec4 color;\n"
+"void main()\n"
+"{\n"
+"   FragColor = color;\n"
+"}\n\0";
+
+const float backgroundColor[] = { 0.2f, 1.0f, 1.0f, 1.0f };
+
+struct BenchmarkOptions
+{
+    int triangleCount = 100000;
+    float triangleSize = 24.0f;     // rough edge length in pixels
+    int frameCount = 10;
+    int threadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+    bool wireframe = false;
+    bool gl = true;
+};
+
+BenchmarkOptions parseBenchmarkOptions(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(arg, "--triangles") == 0 && hasValue)
+            options.triangleCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--size") == 0 && hasValue)
+            options.triangleSize = (float)std::atof(argv[++i]);
+        else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+            options.frameCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--threads") == 0 && hasValue)
+            options.threadCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--wireframe") == 0)
+            options.wireframe = true;
+        else if (std::strcmp(arg, "--no-gl") == 0)
+            options.gl = false;
+        else
+            std::cerr << "Ignoring unknown option " << arg << std::endl;
+    }
+    return options;
+}
+
+// Random triangles spread over the screen, in runs of one color like a real scene
+void buildRandomScene(SceneBatch& batch, int triangleCount, float triangleSize)
+{
+    const float palette[][4] = {
+        { 0.0f, 0.0f, 0.1f, 1.0f },
+        { 1.0f, 0.84f, 0.0f, 1.0f },
+        { 1.0f, 0.2f, 0.2f, 1.0f },
+        { 0.8f, 0.8f, 0.8f, 1.0f },
+        { 0.0f, 0.0f, 0.0f, 1.0f },
+        { 0.6f, 0.8f, 1.0f, 1.0f },
+    };
+    const int paletteSize = sizeof(palette) / sizeof(palette[0]);
+    const int trianglesPerShape = 256;
+
+    std::mt19937 random(1807102);
+    std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    float spanX = triangleSize * 2.0f / SCR_WIDTH;
+    float spanY = triangleSize * 2.0f / SCR_HEIGHT;
+
+    std::vector<float> vertices;
+    for (int first = 0, shape = 0; first < triangleCount; first += trianglesPerShape, shape++)
+    {
+        int count = std::min(trianglesPerShape, triangleCount - first);
+        vertices.clear();
+        for (int t = 0; t < count; t++)
+        {
+            float x = position(random), y = position(random);
+            for (int v = 0; v < 3; v++)
+            {
+                vertices.push_back(x + offset(random) * spanX);
+                vertices.push_back(y + offset(random) * spanY);
+                vertices.push_back(0.0f);
+            }
+        }
+        int color = batch.addColor(palette[shape % paletteSize]);
+        batch.addShape(GL_TRIANGLES, color, vertices.data(), count * 3);
+    }
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printRate(const char* label, long long triangles, double ms)
+{
+    std::cout << label << ": " << ms << " ms, " << triangles / (ms * 1000.0) << " M triangles/s" << std::endl;
+}
+
+// Transform every vertex of the scene by a translate * rotate * scale matrix, once per
+// frame with a different angle each time: per vertex with glm::mat4 on the x, y, z
+// layout, then with the scalar and vector batch kernels on x and y arrays
+void benchmarkAffine(const SceneBatch& scene, int frameCount)
+{
+    const std::vector<float>& vertices = scene.vertices();
+    size_t count = vertices.size() / 3;
+    long long verticesPerRun = (long long)count * frameCount;
+    std::vector<float> xs, ys, outX(count), outY(count);
+    splitPositions(vertices.data(), count, xs, ys);
+    std::vector<glm::vec4> glmOut(count);
+
+    Transform2D transform;
+    transform.setTranslation(0.1f, -0.2f);
+    transform.setScale(0.9f, 1.1f);
+
+    auto glmStart = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frameCount; frame++)
+    {
+        transform.setRotation(frame * 7.0f);
+        const glm::mat4& matrix = transform.matrix();
+        for (size_t i = 0; i < count; i++)
+            glmOut[i] = matrix * glm::vec4(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2], 1.0f);
+    }
+    double glmMs = millisecondsSince(glmStart);
+
+    auto scalarStart = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frameCount; frame++)
+    {
+        transform.setRotation(frame * 7.0f);
+        transformPointsScalar(Affine2D::fromMatrix(transform.matrix()), xs.data(), ys.data(), outX.data(), outY.data(), count);
+    }
+    double scalarMs = millisecondsSince(scalarStart);
+
+    auto batchStart = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frameCount; frame++)
+    {
+        transform.setRotation(frame * 7.0f);
+        transformPoints(Affine2D::fromMatrix(transform.matrix()), xs.data(), ys.data(), outX.data(), outY.data(), count);
+    }
+    double batchMs = millisecondsSince(batchStart);
+
+    // the last frame of each must agree to within rounding
+    float maxError = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        maxError = std::max(maxError, std::max(std::abs(glmOut[i].x - outX[i]), std::abs(glmOut[i].y - outY[i])));
+
+    std::cout << "vertex transforms of " << count << " vertices:" << std::endl;
+    std::cout << "  glm::mat4 per vertex: " << glmMs << " ms, " << verticesPerRun / (glmMs * 1000.0) << " M vertices/s" << std::endl;
+    std::cout << "  batch (scalar): " << scalarMs << " ms, " << verticesPerRun / (scalarMs * 1000.0) << " M vertices/s" << std::endl;
+    std::cout << "  batch (" << affineBatchKernel() << "): " << batchMs << " ms, " << verticesPerRun / (batchMs * 1000.0)
+        << " M vertices/s, " << glmMs / batchMs << "x glm, largest difference " << maxError << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options = parseBenchmarkOptions(argc, argv);
+
+    SceneBatch scene;
+    buildRandomScene(scene, options.triangleCount, options.triangleSize);
+    long long trianglesPerRun = (long long)options.triangleCount * options.frameCount;
+    std::cout << options.triangleCount << " triangles of about " << options.triangleSize << " px, "
+        << options.frameCount << " frames, " << (options.wireframe ? "wireframe" : "filled") << std::endl;
+
+    benchmarkAffine(scene, options.frameCount);
+
+#if defined(SOFT_RASTER_AVX2)
+    const char* kernel = "AVX2";
+#elif defined(SOFT_RASTER_SSE2)
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar";
+#endif
+
+    // Software rasterizer, at every thread count
+    SoftwareRasterizer rasterizer;
+    rasterizer.resize(SCR_WIDTH, SCR_HEIGHT);
+    rasterizer.setPolygonMode(options.wireframe ? GL_LINE : GL_FILL);
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < options.threadCount; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(options.threadCount);
+
+    double singleThreadMs = 0.0;
+    for (int threads : threadCounts)
+    {
+        rasterizer.setThreadCount(threads);
+        auto softwareStart = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < options.frameCount; frame++)
+        {
+            rasterizer.clear(backgroundColor);
+            rasterizer.drawBatch(scene);
+            rasterizer.flush();
+        }
+        double softwareMs = millisecondsSince(softwareStart);
+        if (threads == 1)
+            singleThreadMs = softwareMs;
+
+        std::string label = std::string("software (") + kernel + ", " + std::to_string(threads) + " threads)";
+        printRate(label.c_str(), trianglesPerRun, softwareMs);
+        std::cout << "  speedup over 1 thread: " << singleThreadMs / softwareMs << "x" << std::endl;
+    }
+
+    std::vector<unsigned char> softwarePixels;
+    rasterizer.readPixels(softwarePixels);
+    if (!options.gl)
+        return 0;
+
+    // The GL driver, drawing the same batch into an offscreen framebuffer
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialize GLFW" << std::endl;
+        return -1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "benchmark", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cerr << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    OffscreenTarget offscreen;
+    if (!offscreen.create(SCR_WIDTH, SCR_HEIGHT))
+    {
+        std::cerr << "Failed to create offscreen framebuffer" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    offscreen.bind();
+
+    ShaderCache shaderCache;
+    unsigned int flatShaderProgram = shaderCache.getProgram(vertexShaderSource, flatColorFragmentShaderSource);
+    if (flatShaderProgram == 0)
+        return -1;
+    int colorLocation = glGetUniformLocation(flatShaderProgram, "color");
+    glUseProgram(flatShaderProgram);
+    scene.upload();
+    if (options.wireframe)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    // one untimed frame so shader and buffer setup stay out of the measurement
+    glClear(GL_COLOR_BUFFER_BIT);
+    scene.draw(colorLocation);
+    glFinish();
+
+    auto glStart = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frameCount; frame++)
+    {
+        glClearColor(backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3]);
+        glClear(GL_COLOR_BUFFER_BIT);
+        scene.draw(colorLocation);
+    }
+    glFinish();
+    std::string renderer = std::string("GL (") + (const char*)glGetString(GL_RENDERER) + ")";
+    printRate(renderer.c_str(), trianglesPerRun, millisecondsSince(glStart));
+
+    // Pixels whose color differs by more than rounding; these sit on triangle edges
+    std::vector<unsigned char> glPixels;
+    offscreen.readPixels(glPixels);
+    long long differing = 0;
+    for (size_t i = 0; i < glPixels.size(); i += 4)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (std::abs(glPixels[i + c] - softwarePixels[i + c]) > 1)
+            {
+                differing++;
+                break;
+            }
+        }
+    }
+    std::cout << differing << " of " << glPixels.size() / 4 << " pixels differ ("
+        << differing * 100.0 / (glPixels.size() / 4) << "%)" << std::endl;
+
+    scene.destroy();
+    offscreen.destroy();
+    shaderCache.destroy();
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "offscreen.h"
+
+// Records every frame to a numbered PPM sequence without stalling the render loop.
+//
+// capture() only queues a glReadPixels into one of a ring of pixel buffer objects and
+// drops a fence behind it. The PBO is mapped again when the ring comes back around,
+// by which time the GPU has long finished the copy, so frame N is read back while
+// frames N+1.. render. Mapped pixels are handed to a writer thread that encodes and
+// saves them; if the disk falls behind, capture() blocks once maxQueuedFrames are waiting.
+class FrameCapture
+{
+public:
+    bool start(const char* directory, int frameWidth, int frameHeight, int ringSize = 3)
+    {
+#ifdef _WIN32
+        _mkdir(directory);
+#else
+        mkdir(directory, 0755);
+#endif
+        directory_ = directory;
+        width_ = frameWidth;
+        height_ = frameHeight;
+        frameBytes_ = (size_t)width_ * height_ * 4;
+
+        slots_.resize(ringSize);
+        for (Slot& slot : slots_)
+        {
+            glGenBuffers(1, &slot.PBO);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes_, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        stopping_ = false;
+        writer_ = std::thread(&FrameCapture::writerLoop, this);
+        return true;
+    }
+
+    // Queue a readback of the currently bound read framebuffer
+    void capture()
+    {
+        Slot& slot = slots_[nextFrame_ % slots_.size()];
+        if (slot.fence)
+            collect(slot);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.frame = nextFrame_++;
+    }
+
+    // Collect the readbacks still in flight, wait for the writer and free the PBOs
+    void finish()
+    {
+        for (size_t i = 0; i < slots_.size(); i++)
+        {
+            Slot& slot = slots_[(nextFrame_ + i) % slots_.size()];
+            if (slot.fence)
+                collect(slot);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        queueChanged_.notify_all();
+        if (writer_.joinable())
+            writer_.join();
+
+        for (Slot& slot : slots_)
+            glDeleteBuffers(1, &slot.PBO);
+        slots_.clear();
+    }
+
+    int framesWritten() const { return framesWritten_; }
+
+    static const size_t maxQueuedFrames = 8;
+
+private:
+    struct Slot
+    {
+        unsigned int PBO = 0;
+        GLsync fence = 0;
+        int frame = 0;
+    };
+
+    struct Job
+    {
+        int frame;
+        std::vector<unsigned char> pixels;
+    };
+
+    void collect(Slot& slot)
+    {
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        Job job;
+        job.frame = slot.frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queueChanged_.wait(lock, [this] { return jobs_.size() < maxQueuedFrames; });
+            if (!freeBuffers_.empty())
+            {
+                job.pixels.swap(freeBuffers_.back());
+                freeBuffers_.pop_back();
+            }
+        }
+        job.pixels.resize(frameBytes_);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes_, GL_MAP_READ_BIT);
+        if (mapped)
+        {
+            std::memcpy(job.pixels.data(), mapped, frameBytes_);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        queueChanged_.notify_all();
+    }
+
+    void writerLoop()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                queueChanged_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            queueChanged_.notify_all();
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "/frame_%05d.ppm", job.frame);
+            if (writePPM((directory_ + name).c_str(), width_, height_, job.pixels.data()))
+                framesWritten_++;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            freeBuffers_.push_back(std::move(job.pixels));
+        }
+    }
+
+    std::string directory_;
+    int width_ = 0;
+    int height_ = 0;
+    size_t frameBytes_ = 0;
+    std::vector<Slot> slots_;
+    int nextFrame_ = 0;
+
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable queueChanged_;
+    std::deque<Job> jobs_;
+    std::vector<std::vector<unsigned char>> freeBuffers_;
+    bool stopping_ = false;
+    int framesWritten_ = 0;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Fixed-timestep clock for the simulation.
+//
+// Real frame time is accumulated and handed out as whole steps of step() seconds, so the
+// simulation advances by the same amounts whatever the frame rate. What is left over,
+// as a fraction of a step, is alpha(): render the state that far between the previous
+// step and the latest one. After a long stall (a breakpoint, a window drag) at most
+// maxSteps steps are run and the rest of the backlog is dropped instead of making the
+// next frames slower still.
+class FixedTimestep
+{
+public:
+    explicit FixedTimestep(double stepSeconds = 1.0 / 120.0, int maxSteps = 8)
+        : step_(stepSeconds), maxSteps_(maxSteps)
+    {
+    }
+
+    // Add a frame's worth of time and return how many steps to simulate for it
+    int advance(double frameSeconds)
+    {
+        accumulator_ += std::max(0.0, frameSeconds);
+        int steps = (int)(accumulator_ / step_);
+        accumulator_ -= steps * step_;
+        if (steps > maxSteps_)
+        {
+            droppedSeconds_ += (steps - maxSteps_) * step_;
+            steps = maxSteps_;
+        }
+        totalSteps_ += steps;
+        return steps;
+    }
+
+    double step() const { return step_; }
+    float alpha() const { return (float)(accumulator_ / step_); }
+    long long totalSteps() const { return totalSteps_; }
+    double droppedSeconds() const { return droppedSeconds_; }
+
+private:
+    double step_;
+    int maxSteps_;
+    double accumulator_ = 0.0;
+    long long totalSteps_ = 0;
+    double droppedSeconds_ = 0.0;
+};
+
+// How fast frames are presented: as fast as possible, at the display's refresh rate, or
+// at a fixed target rate paced by the CPU
+class FramePacer
+{
+public:
+    // targetFps 0 means no target; vsync applies only to a window that presents
+    void start(bool vsync, int targetFps)
+    {
+        glfwSwapInterval(vsync ? 1 : 0);
+        period_ = targetFps > 0 ? std::chrono::duration<double>(1.0 / targetFps) : std::chrono::duration<double>(0.0);
+        deadline_ = std::chrono::steady_clock::now();
+    }
+
+    // Wait for the start of the next frame at the target rate: sleep through most of the
+    // gap and spin the last bit, since sleeps on some systems overshoot by milliseconds
+    void wait()
+    {
+        if (period_.count() <= 0.0)
+            return;
+
+        deadline_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period_);
+        auto now = std::chrono::steady_clock::now();
+        if (deadline_ < now)
+        {
+            // running behind: start counting from here instead of rushing to catch up
+            deadline_ = now;
+            return;
+        }
+        auto spinFrom = deadline_ - std::chrono::milliseconds(2);
+        if (now < spinFrom)
+            std::this_thread::sleep_until(spinFrom);
+        while (std::chrono::steady_clock::now() < deadline_)
+            std::this_thread::yield();
+    }
+
+private:
+    std::chrono::duration<double> period_{ 0.0 };
+    std::chrono::steady_clock::time_point deadline_;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Two-stage frame pipeline: a worker thread prepares frame N+1 (transforms, draw lists,
+// culling) while the thread that owns the GL context submits frame N.
+//
+// Frames live in two slots used in turn. Each slot has one atomic state word: the worker
+// fills a free slot and marks it ready, the GL thread takes a ready slot and marks it free
+// once it has been drawn. Neither side takes a lock, and a slot is never touched by both
+// at once, so the frame data itself needs no synchronization. A side that finds its slot
+// not yet handed over yields for a while and then sleeps, so an idle pipeline (a GL
+// thread sleeping in glfwWaitEvents) does not keep a core busy.
+//
+// The price is a frame of latency: what the GL thread draws was prepared from the input
+// available one frame earlier.
+template <typename Frame>
+class FramePipeline
+{
+public:
+    ~FramePipeline() { stop(); }
+
+    // Run prepare(frame, frameIndex) on the worker for every frame until stop()
+    template <typename Prepare>
+    void start(Prepare prepare)
+    {
+        stop();
+        running_.store(true);
+        worker_ = std::thread([this, prepare]() mutable {
+            for (long long index = 0;; index++)
+            {
+                Slot& slot = slots_[index & 1];
+                if (!waitFor(slot, slotFree, producerWaits_))
+                    return;
+                prepare(slot.frame, index);
+                slot.state.store(slotReady, std::memory_order_release);
+            }
+        });
+    }
+
+    // The next prepared frame, waiting for the worker if it is not ready yet; NULL when
+    // the pipeline is not running. Hand it back with release() once it has been drawn.
+    Frame* acquire()
+    {
+        Slot& slot = slots_[consumed_ & 1];
+        if (!waitFor(slot, slotReady, consumerWaits_))
+            return NULL;
+        return &slot.frame;
+    }
+
+    void release()
+    {
+        slots_[consumed_ & 1].state.store(slotFree, std::memory_order_release);
+        consumed_++;
+    }
+
+    // Stop and join the worker; frames not yet drawn are dropped
+    void stop()
+    {
+        if (!worker_.joinable())
+            return;
+        running_.store(false);
+        worker_.join();
+        for (Slot& slot : slots_)
+            slot.state.store(slotFree);
+        consumed_ = 0;
+    }
+
+    // Frames where the worker found both slots still in use (the GL thread is the
+    // bottleneck) and where the GL thread found its frame not ready (the worker is)
+    long long producerWaits() const { return producerWaits_.load(); }
+    long long consumerWaits() const { return consumerWaits_.load(); }
+
+private:
+    static const int slotFree = 0;
+    static const int slotReady = 1;
+
+    struct Slot
+    {
+        std::atomic<int> state{ slotFree };
+        Frame frame;
+    };
+
+    // Wait until slot is in state; false if the pipeline stopped first
+    bool waitFor(Slot& slot, int state, std::atomic<long long>& waits)
+    {
+        if (slot.state.load(std::memory_order_acquire) == state)
+            return true;
+        waits.fetch_add(1, std::memory_order_relaxed);
+        for (int attempt = 0; slot.state.load(std::memory_order_acquire) != state; attempt++)
+        {
+            if (!running_.load(std::memory_order_relaxed))
+                return false;
+            if (attempt < 1000)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    Slot slots_[2];
+    long long consumed_ = 0;
+    std::atomic<bool> running_{ false };
+    std::atomic<long long> producerWaits_{ 0 };
+    std::atomic<long long> consumerWaits_{ 0 };
+    std::thread worker_;
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Per-frame timings of named sections of the render loop.
+//
+// Every section is timed on the CPU; sections added with gpu = true are also wrapped in
+// a GL_TIME_ELAPSED query. Queries rotate through queryLatency sets and a result is
+// only read back when its set comes around again and GL reports it available, so the
+// profiler never makes the CPU wait for the GPU. GPU timer queries cannot nest, so GPU
+// sections must not overlap each other.
+class FrameProfiler
+{
+public:
+    static const int queryLatency = 3;
+
+    int addSection(const char* name, bool gpu)
+    {
+        Section section;
+        section.name = name;
+        section.gpu = gpu;
+        if (gpu)
+        {
+            section.queries.resize(queryLatency);
+            section.queryFrames.assign(queryLatency, -1);
+            glGenQueries(queryLatency, section.queries.data());
+        }
+        sections_.push_back(section);
+        return (int)sections_.size() - 1;
+    }
+
+    void beginFrame()
+    {
+        FrameRow row;
+        row.cpuMs.assign(sections_.size(), 0.0);
+        row.gpuMs.assign(sections_.size(), -1.0);
+        rows_.push_back(row);
+        frameStart_ = Clock::now();
+    }
+
+    void endFrame()
+    {
+        rows_.back().frameMs = millisecondsSince(frameStart_);
+    }
+
+    void begin(int section)
+    {
+        Section& s = sections_[section];
+        s.start = Clock::now();
+        if (!s.gpu)
+            return;
+
+        int frame = (int)rows_.size() - 1;
+        int slot = frame % queryLatency;
+        collect(s, slot);
+        glBeginQuery(GL_TIME_ELAPSED, s.queries[slot]);
+        s.queryFrames[slot] = frame;
+    }
+
+    void end(int section)
+    {
+        Section& s = sections_[section];
+        if (s.gpu)
+            glEndQuery(GL_TIME_ELAPSED);
+        rows_.back().cpuMs[section] += millisecondsSince(s.start);
+    }
+
+    // Print p50/p95/p99 of every section and of the whole frame
+    void report(std::ostream& out)
+    {
+        out << "Frame timings over " << rows_.size() << " frames (ms, p50 / p95 / p99)" << std::endl;
+        printPercentiles(out, "frame cpu", [](const FrameRow& row, int) { return row.frameMs; }, 0);
+        for (int i = 0; i < (int)sections_.size(); i++)
+        {
+            printPercentiles(out, sections_[i].name + " cpu", [](const FrameRow& row, int s) { return row.cpuMs[s]; }, i);
+            if (sections_[i].gpu)
+                printPercentiles(out, sections_[i].name + " gpu", [](const FrameRow& row, int s) { return row.gpuMs[s]; }, i);
+        }
+    }
+
+    // One row per frame; GPU columns are empty where the query had not finished in time
+    bool writeCsv(const char* path)
+    {
+        FILE* file = std::fopen(path, "w");
+        if (!file)
+            return false;
+
+        std::fprintf(file, "frame,frame_cpu_ms");
+        for (const Section& s : sections_)
+        {
+            std::fprintf(file, ",%s_cpu_ms", s.name.c_str());
+            if (s.gpu)
+                std::fprintf(file, ",%s_gpu_ms", s.name.c_str());
+        }
+        std::fprintf(file, "\n");
+
+        for (size_t f = 0; f < rows_.size(); f++)
+        {
+            const FrameRow& row = rows_[f];
+            std::fprintf(file, "%d,%.4f", (int)f, row.frameMs);
+            for (size_t i = 0; i < sections_.size(); i++)
+            {
+                std::fprintf(file, ",%.4f", row.cpuMs[i]);
+                if (sections_[i].gpu)
+                {
+                    if (row.gpuMs[i] >= 0.0)
+                        std::fprintf(file, ",%.4f", row.gpuMs[i]);
+                    else
+                        std::fprintf(file, ",");
+                }
+            }
+            std::fprintf(file, "\n");
+        }
+        return std::fclose(file) == 0;
+    }
+
+    // Percentile summary as JSON: {"frames": n, "frame_cpu_ms": {...}, "<section>_cpu_ms": {...}, ...}
+    bool writeJson(const char* path)
+    {
+        FILE* file = std::fopen(path, "w");
+        if (!file)
+            return false;
+
+        std::fprintf(file, "{\n  \"frames\": %d", (int)rows_.size());
+        writeJsonPercentiles(file, "frame_cpu_ms", [](const FrameRow& row, int) { return row.frameMs; }, 0);
+        for (int i = 0; i < (int)sections_.size(); i++)
+        {
+            writeJsonPercentiles(file, sections_[i].name + "_cpu_ms", [](const FrameRow& row, int s) { return row.cpuMs[s]; }, i);
+            if (sections_[i].gpu)
+                writeJsonPercentiles(file, sections_[i].name + "_gpu_ms", [](const FrameRow& row, int s) { return row.gpuMs[s]; }, i);
+        }
+        std::fprintf(file, "\n}\n");
+        return std::fclose(file) == 0;
+    }
+
+    // Write CSV or JSON depending on the extension of path
+    bool write(const std::string& path)
+    {
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        return json ? writeJson(path.c_str()) : writeCsv(path.c_str());
+    }
+
+    // Read back the queries still in flight (this may wait) and delete them
+    void finish()
+    {
+        for (Section& s : sections_)
+        {
+            if (!s.gpu)
+                continue;
+            for (int slot = 0; slot < queryLatency; slot++)
+                collect(s, slot, true);
+            glDeleteQueries(queryLatency, s.queries.data());
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Section
+    {
+        std::string name;
+        bool gpu = false;
+        Clock::time_point start;
+        std::vector<GLuint> queries;
+        std::vector<int> queryFrames;
+    };
+
+    struct FrameRow
+    {
+        double frameMs = 0.0;
+        std::vector<double> cpuMs;
+        std::vector<double> gpuMs;
+    };
+
+    static double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void collect(Section& s, int slot, bool wait = false)
+    {
+        int frame = s.queryFrames[slot];
+        if (frame < 0)
+            return;
+
+        GLint available = 0;
+        if (wait)
+            available = 1;
+        else
+            glGetQueryObjectiv(s.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (available)
+        {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(s.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+            int section = (int)(&s - sections_.data());
+            rows_[frame].gpuMs[section] = nanoseconds / 1.0e6;
+        }
+        s.queryFrames[slot] = -1;
+    }
+
+    template <typename Getter>
+    bool percentiles(Getter get, int section, double result[3]) const
+    {
+        std::vector<double> values;
+        values.reserve(rows_.size());
+        for (const FrameRow& row : rows_)
+        {
+            double value = get(row, section);
+            if (value >= 0.0)
+                values.push_back(value);
+        }
+        if (values.empty())
+            return false;
+
+        std::sort(values.begin(), values.end());
+        const double ranks[3] = { 0.50, 0.95, 0.99 };
+        for (int i = 0; i < 3; i++)
+        {
+            size_t index = (size_t)(ranks[i] * (values.size() - 1) + 0.5);
+            result[i] = values[index];
+        }
+        return true;
+    }
+
+    template <typename Getter>
+    void printPercentiles(std::ostream& out, const std::string& label, Getter get, int section) const
+    {
+        double p[3];
+        if (!percentiles(get, section, p))
+            return;
+        char line[128];
+        std::snprintf(line, sizeof(line), "  %-16s %8.3f %8.3f %8.3f", label.c_str(), p[0], p[1], p[2]);
+        out << line << std::endl;
+    }
+
+    template <typename Getter>
+    void writeJsonPercentiles(FILE* file, const std::string& key, Getter get, int section) const
+    {
+        double p[3];
+        if (!percentiles(get, section, p))
+            return;
+        std::fprintf(file, ",\n  \"%s\": { \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }", key.c_str(), p[0], p[1], p[2]);
+    }
+
+    std::vector<Section> sections_;
+    std::vector<FrameRow> rows_;
+    Clock::time_point frameStart_;
+};
+
+// Times the enclosing block as one section of the current frame
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler* profiler, int section)
+        : profiler_(profiler), section_(section)
+    {
+        if (profiler_)
+            profiler_->begin(section_);
+    }
+
+    ~ProfileScope()
+    {
+        if (profiler_)
+            profiler_->end(section_);
+    }
+
+private:
+    FrameProfiler* profiler_;
+    int section_;
+};
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Creates, recycles and accounts for the GL buffers, vertex arrays and programs behind
+// the handle types below.
+//
+// A released buffer keeps its storage and goes on a free list for its usage and size
+// class; the next request of that class gets it back and only writes its data with
+// glBufferSubData, with no glGenBuffers or glBufferData storage allocation. Size classes
+// are quarter steps between powers of two from 256 bytes, so a buffer is at most a
+// quarter larger than asked for. Released vertex arrays are reset (attributes disabled,
+// no element buffer) and reused the same way. Programs are only counted: a linked
+// program cannot be turned into a different one.
+//
+// Every live object is tracked, so report() can list what is still alive at shutdown.
+// The pool is not thread safe; use it from the thread that owns the GL context. Objects
+// released when no context is current (after glfwTerminate) are only forgotten.
+class GLObjectPool
+{
+public:
+    // The pool the handles use unless given another. It is never destroyed, so handles
+    // in globals can still release into it after main returns.
+    static GLObjectPool& shared()
+    {
+        static GLObjectPool* pool = new GLObjectPool();
+        return *pool;
+    }
+
+    // Storage a buffer of bytes gets: 256 bytes, or bytes rounded up to a quarter of
+    // the power of two below it
+    static size_t sizeClass(size_t bytes)
+    {
+        if (bytes <= 256)
+            return 256;
+        size_t octave = 256;
+        while (octave <= bytes / 2)
+            octave *= 2;
+        size_t step = octave / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    // A buffer with storage for at least bytes, bound to target; its contents are undefined
+    GLuint acquireBuffer(GLenum target, size_t bytes, GLenum usage)
+    {
+        size_t capacity = sizeClass(bytes);
+        bufferRequests_++;
+
+        GLuint name = 0;
+        auto found = freeBuffers_.find(std::make_pair(usage, capacity));
+        if (found != freeBuffers_.end() && !found->second.empty())
+        {
+            name = found->second.back();
+            found->second.pop_back();
+            pooledBufferBytes_ -= capacity;
+            pooledBufferCount_--;
+            buffersRecycled_++;
+            glBindBuffer(target, name);
+        }
+        else
+        {
+            glGenBuffers(1, &name);
+            glBindBuffer(target, name);
+            glBufferData(target, capacity, NULL, usage);
+        }
+
+        LiveBuffer live = { capacity, usage };
+        liveBuffers_[name] = live;
+        liveBufferBytes_ += capacity;
+        return name;
+    }
+
+    void releaseBuffer(GLuint name)
+    {
+        auto found = liveBuffers_.find(name);
+        if (found == liveBuffers_.end())
+            return;
+        LiveBuffer live = found->second;
+        liveBuffers_.erase(found);
+        liveBufferBytes_ -= live.capacity;
+        if (!contextCurrent())
+            return;
+
+        if (pooledBufferBytes_ + live.capacity <= maxPooledBytes)
+        {
+            freeBuffers_[std::make_pair(live.usage, live.capacity)].push_back(name);
+            pooledBufferBytes_ += live.capacity;
+            pooledBufferCount_++;
+        }
+        else
+            glDeleteBuffers(1, &name);
+    }
+
+    GLuint acquireVertexArray()
+    {
+        vertexArrayRequests_++;
+        GLuint name = 0;
+        if (!freeVertexArrays_.empty())
+        {
+            name = freeVertexArrays_.back();
+            freeVertexArrays_.pop_back();
+            vertexArraysRecycled_++;
+        }
+        else
+            glGenVertexArrays(1, &name);
+        liveVertexArrays_.insert(name);
+        return name;
+    }
+
+    void releaseVertexArray(GLuint name)
+    {
+        if (liveVertexArrays_.erase(name) == 0 || !contextCurrent())
+            return;
+
+        // back to the state of a new vertex array, so the next owner only sets what it uses.
+        // The previous binding is restored afterwards: state caches such as the render
+        // queue's still take it to be bound.
+        if (maxAttributes_ == 0)
+            glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes_);
+        GLint previous = 0;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+        glBindVertexArray(name);
+        for (GLint i = 0; i < maxAttributes_; i++)
+        {
+            glDisableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 0);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindVertexArray((GLuint)previous);
+        freeVertexArrays_.push_back(name);
+    }
+
+    GLuint createProgram()
+    {
+        GLuint name = glCreateProgram();
+        livePrograms_.insert(name);
+        return name;
+    }
+
+    void deleteProgram(GLuint name)
+    {
+        if (livePrograms_.erase(name) != 0 && contextCurrent())
+            glDeleteProgram(name);
+    }
+
+    // Delete every pooled buffer and vertex array; call before the context goes away
+    void trim()
+    {
+        if (contextCurrent())
+        {
+            for (auto& entry : freeBuffers_)
+                if (!entry.second.empty())
+                    glDeleteBuffers((GLsizei)entry.second.size(), entry.second.data());
+            if (!freeVertexArrays_.empty())
+                glDeleteVertexArrays((GLsizei)freeVertexArrays_.size(), freeVertexArrays_.data());
+        }
+        freeBuffers_.clear();
+        freeVertexArrays_.clear();
+        pooledBufferBytes_ = 0;
+        pooledBufferCount_ = 0;
+    }
+
+    // Live objects and bytes, what the pool holds and how often it saved a glGen call;
+    // at shutdown every live object is a leak and is listed, up to maxListed of them
+    void report(std::ostream& out, int maxListed = 16) const
+    {
+        out << "GL objects live: " << liveBuffers_.size() << " buffers (" << liveBufferBytes_ << " bytes), "
+            << liveVertexArrays_.size() << " vertex arrays, " << livePrograms_.size() << " programs" << std::endl;
+        out << "GL object pool: " << pooledBufferCount_ << " buffers (" << pooledBufferBytes_ << " bytes) and "
+            << freeVertexArrays_.size() << " vertex arrays free, " << buffersRecycled_ << " of " << bufferRequests_
+            << " buffers and " << vertexArraysRecycled_ << " of " << vertexArrayRequests_ << " vertex arrays recycled" << std::endl;
+
+        int listed = 0;
+        for (const auto& entry : liveBuffers_)
+            if (listed++ < maxListed)
+                out << "  buffer " << entry.first << ": " << entry.second.capacity << " bytes" << std::endl;
+        for (GLuint name : liveVertexArrays_)
+            if (listed++ < maxListed)
+                out << "  vertex array " << name << std::endl;
+        for (GLuint name : livePrograms_)
+            if (listed++ < maxListed)
+                out << "  program " << name << std::endl;
+        if (listed > maxListed)
+            out << "  ... and " << listed - maxListed << " more" << std::endl;
+    }
+
+    int liveBufferCount() const { return (int)liveBuffers_.size(); }
+    size_t liveBufferBytes() const { return liveBufferBytes_; }
+    int liveVertexArrayCount() const { return (int)liveVertexArrays_.size(); }
+    int liveProgramCount() const { return (int)livePrograms_.size(); }
+    size_t pooledBufferBytes() const { return pooledBufferBytes_; }
+
+    // Released buffers beyond this much pooled storage are deleted instead
+    size_t maxPooledBytes = 64 << 20;
+
+private:
+    struct LiveBuffer
+    {
+        size_t capacity;
+        GLenum usage;
+    };
+
+    static bool contextCurrent() { return glfwGetCurrentContext() != NULL; }
+
+    std::unordered_map<GLuint, LiveBuffer> liveBuffers_;
+    std::map<std::pair<GLenum, size_t>, std::vector<GLuint>> freeBuffers_;   // by usage and size class
+    std::set<GLuint> liveVertexArrays_;
+    std::vector<GLuint> freeVertexArrays_;
+    std::set<GLuint> livePrograms_;
+
+    size_t liveBufferBytes_ = 0;
+    size_t pooledBufferBytes_ = 0;
+    int pooledBufferCount_ = 0;
+    long long bufferRequests_ = 0, buffersRecycled_ = 0;
+    long long vertexArrayRequests_ = 0, vertexArraysRecycled_ = 0;
+    GLint maxAttributes_ = 0;
+};
+
+// Move-only buffer handle. data() gets storage from the pool on first use and whenever
+// the size class or usage changes; otherwise it writes into the storage it has. The
+// buffer goes back to the pool on reset() or destruction. Converts to its GL name, 0
+// while it holds no buffer.
+class GLBuffer
+{
+public:
+    GLBuffer() {}
+    GLBuffer(const GLBuffer&) = delete;
+    GLBuffer& operator=(const GLBuffer&) = delete;
+
+    GLBuffer(GLBuffer&& other) noexcept { take(other); }
+
+    GLBuffer& operator=(GLBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~GLBuffer() { reset(); }
+
+    // Bind the buffer to target and give it bytes of data; NULL data leaves the
+    // contents undefined
+    void data(GLenum target, size_t bytes, const void* data, GLenum usage, GLObjectPool& pool = GLObjectPool::shared())
+    {
+        if (name_ == 0 || GLObjectPool::sizeClass(bytes) != capacity_ || usage != usage_ || pool_ != &pool)
+        {
+            reset();
+            pool_ = &pool;
+            name_ = pool.acquireBuffer(target, bytes, usage);
+            capacity_ = GLObjectPool::sizeClass(bytes);
+            usage_ = usage;
+        }
+        else
+            glBindBuffer(target, name_);
+
+        if (data != NULL && bytes > 0)
+            glBufferSubData(target, 0, bytes, data);
+        size_ = bytes;
+    }
+
+    void reset()
+    {
+        if (name_ != 0)
+            pool_->releaseBuffer(name_);
+        name_ = 0;
+        size_ = 0;
+        capacity_ = 0;
+    }
+
+    operator GLuint() const { return name_; }
+
+    // Bytes last given to data(), and the storage behind them
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    void take(GLBuffer& other)
+    {
+        pool_ = other.pool_;
+        name_ = other.name_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        usage_ = other.usage_;
+        other.name_ = 0;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    GLObjectPool* pool_ = NULL;
+    GLuint name_ = 0;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    GLenum usage_ = 0;
+};
+
+// Move-only vertex array handle; create() takes one from the pool if it has none yet
+class GLVertexArray
+{
+public:
+    GLVertexArray() {}
+    GLVertexArray(const GLVertexArray&) = delete;
+    GLVertexArray& operator=(const GLVertexArray&) = delete;
+
+    GLVertexArray(GLVertexArray&& other) noexcept : pool_(other.pool_), name_(other.name_) { other.name_ = 0; }
+
+    GLVertexArray& operator=(GLVertexArray&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            pool_ = other.pool_;
+            name_ = other.name_;
+            other.name_ = 0;
+        }
+        return *this;
+    }
+
+    ~GLVertexArray() { reset(); }
+
+    void create(GLObjectPool& pool = GLObjectPool::shared())
+    {
+        if (name_ != 0)
+            return;
+        pool_ = &pool;
+        name_ = pool.acquireVertexArray();
+    }
+
+    void reset()
+    {
+        if (name_ != 0)
+            pool_->releaseVertexArray(name_);
+        name_ = 0;
+    }
+
+    operator GLuint() const { return name_; }
+
+private:
+    GLObjectPool* pool_ = NULL;
+    GLuint name_ = 0;
+};
+
+// Move-only program handle; create() replaces whatever program it held with a new one
+class GLProgram
+{
+public:
+    GLProgram() {}
+    GLProgram(const GLProgram&) = delete;
+    GLProgram& operator=(const GLProgram&) = delete;
+
+    GLProgram(GLProgram&& other) noexcept : pool_(other.pool_), name_(other.name_) { other.name_ = 0; }
+
+    GLProgram& operator=(GLProgram&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            pool_ = other.pool_;
+            name_ = other.name_;
+            other.name_ = 0;
+        }
+        return *this;
+    }
+
+    ~GLProgram() { reset(); }
+
+    void create(GLObjectPool& pool = GLObjectPool::shared())
+    {
+        reset();
+        pool_ = &pool;
+        name_ = pool.createProgram();
+    }
+
+    void reset()
+    {
+        if (name_ != 0)
+            pool_->deleteProgram(name_);
+        name_ = 0;
+    }
+
+    operator GLuint() const { return name_; }
+
+private:
+    GLObjectPool* pool_ = NULL;
+    GLuint name_ = 0;
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+// Bounded single-producer single-consumer queue. The producer only writes tail_ and
+// the consumer only writes head_, so neither side ever takes a lock.
+template <typename T, uint32_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Returns false (and drops item) when the queue is full
+    bool push(const T& item)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        item = items_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t> head_{ 0 };
+    std::atomic<uint32_t> tail_{ 0 };
+    T items_[Capacity];
+};
+
+// Keyboard input driven by GLFW's key callback instead of polling every key each frame.
+//
+// The callback only queues the event. update() drains the queue: it keeps a bitset of
+// which keys are down and maps keys to actions through a binding table. Afterwards
+// activeActions() lists the actions that are held or were pressed during the drained
+// events, so a tap that starts and ends between two updates still counts once, and
+// code that reacts to input walks only those instead of every binding.
+class InputSystem
+{
+public:
+    static const int keyCount = GLFW_KEY_LAST + 1;
+
+    // Route the window's key events here; the window's user pointer is used for that
+    void attach(GLFWwindow* window)
+    {
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, keyCallback);
+    }
+
+    // Make key trigger action (a small non-negative number chosen by the caller). A key
+    // has at most one action; several keys may share one.
+    void bind(int key, int action)
+    {
+        if (key < 0 || key >= keyCount || action < 0)
+            return;
+        bindings_[key] = action;
+        if ((size_t)action >= held_.size())
+        {
+            held_.resize(action + 1, 0);
+            pressed_.resize(action + 1, 0);
+            active_.resize(action + 1, 0);
+        }
+    }
+
+    // Apply every queued key event and return how many there were
+    int update()
+    {
+        for (int action : pressedList_)
+            pressed_[action] = 0;
+        pressedList_.clear();
+
+        KeyEvent event;
+        int count = 0;
+        while (events_.pop(event))
+        {
+            count++;
+            if (keys_[event.key] == event.down)
+                continue;
+            keys_[event.key] = event.down;
+
+            int action = bindings_[event.key];
+            if (action < 0)
+                continue;
+            if (event.down)
+            {
+                if (held_[action]++ == 0 && !pressed_[action])
+                {
+                    pressed_[action] = 1;
+                    pressedList_.push_back(action);
+                }
+            }
+            else if (held_[action] > 0)
+                held_[action]--;
+        }
+
+        // held actions stay active, released ones drop out, new presses join
+        size_t kept = 0;
+        for (size_t i = 0; i < activeList_.size(); i++)
+        {
+            int action = activeList_[i];
+            if (held_[action] > 0 || pressed_[action])
+                activeList_[kept++] = action;
+            else
+                active_[action] = 0;
+        }
+        activeList_.resize(kept);
+        for (int action : pressedList_)
+        {
+            if (!active_[action])
+            {
+                active_[action] = 1;
+                activeList_.push_back(action);
+            }
+        }
+        return count;
+    }
+
+    bool keyDown(int key) const { return key >= 0 && key < keyCount && keys_[key]; }
+    bool held(int action) const { return (size_t)action < held_.size() && held_[action] > 0; }
+    bool pressed(int action) const { return (size_t)action < pressed_.size() && pressed_[action]; }
+
+    // Actions held now or pressed since the previous update
+    const std::vector<int>& activeActions() const { return activeList_; }
+
+    // Events lost because the queue was full
+    int droppedEvents() const { return droppedEvents_; }
+
+private:
+    struct KeyEvent
+    {
+        int16_t key;
+        bool down;
+    };
+
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+    {
+        InputSystem* input = (InputSystem*)glfwGetWindowUserPointer(window);
+        if (!input || key < 0 || key >= keyCount || action == GLFW_REPEAT)
+            return;
+        KeyEvent event = { (int16_t)key, action == GLFW_PRESS };
+        if (!input->events_.push(event))
+            input->droppedEvents_++;
+    }
+
+    SpscQueue<KeyEvent, 256> events_;
+    int droppedEvents_ = 0;
+
+    std::bitset<keyCount> keys_;
+    std::vector<int> bindings_ = std::vector<int>(keyCount, -1);
+    std::vector<int> held_;         // per action: how many of its keys are down
+    std::vector<char> pressed_;     // per action: went down since the previous update
+    std::vector<char> active_;      // per action: in activeList_
+    std::vector<int> pressedList_;
+    std::vector<int> activeList_;
+};
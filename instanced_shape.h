@@ -0,0 +1,144 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "gl_objects.h"
+#include "render_queue.h"
+#include "scene_batch.h"
+
+// Per-instance data: where the template goes (xy offset, xy scale) and its color
+struct ShapeInstance
+{
+    float offsetScale[4];
+    float color[4];
+};
+
+// A shape template uploaded once and drawn many times with a single instanced draw.
+// Attribute 0 is the template's x, y, z; attributes 1 and 2 advance once per instance
+// and carry ShapeInstance::offsetScale and ShapeInstance::color.
+class InstancedShape
+{
+public:
+    void setTemplate(GLenum primitiveMode, const float* vertices, int vertexCount)
+    {
+        mode = primitiveMode;
+        templateVertices_.assign(vertices, vertices + vertexCount * 3);
+    }
+
+    int addInstance(const float* offsetScale, const float* color)
+    {
+        ShapeInstance instance;
+        for (int i = 0; i < 4; i++)
+        {
+            instance.offsetScale[i] = offsetScale[i];
+            instance.color[i] = color[i];
+        }
+        instances_.push_back(instance);
+        return (int)instances_.size() - 1;
+    }
+
+    // Offset and scale that map the template's bounding box onto the bounding box of
+    // vertices, for turning hand-placed copies of a shape into instances of it
+    void fitInstance(const float* vertices, int vertexCount, float offsetScale[4]) const
+    {
+        float templateBounds[4], bounds[4];
+        boundsOf(templateVertices_.data(), (int)templateVertices_.size() / 3, templateBounds);
+        boundsOf(vertices, vertexCount, bounds);
+
+        offsetScale[2] = (bounds[2] - bounds[0]) / (templateBounds[2] - templateBounds[0]);
+        offsetScale[3] = (bounds[3] - bounds[1]) / (templateBounds[3] - templateBounds[1]);
+        offsetScale[0] = bounds[0] - templateBounds[0] * offsetScale[2];
+        offsetScale[1] = bounds[1] - templateBounds[1] * offsetScale[3];
+    }
+
+    // Add every instance to batch as an ordinary shape with its transform applied, e.g.
+    // to save the scene in a form that has no instancing
+    void expandInto(SceneBatch& batch) const
+    {
+        std::vector<float> vertices(templateVertices_.size());
+        for (const ShapeInstance& instance : instances_)
+        {
+            for (size_t i = 0; i < templateVertices_.size(); i += 3)
+            {
+                vertices[i] = templateVertices_[i] * instance.offsetScale[2] + instance.offsetScale[0];
+                vertices[i + 1] = templateVertices_[i + 1] * instance.offsetScale[3] + instance.offsetScale[1];
+                vertices[i + 2] = templateVertices_[i + 2];
+            }
+            batch.addShape(mode, batch.addColor(instance.color), vertices.data(), (int)vertices.size() / 3);
+        }
+    }
+
+    void upload()
+    {
+        VAO.create();
+        glBindVertexArray(VAO);
+        templateVBO.data(GL_ARRAY_BUFFER, templateVertices_.size() * sizeof(float), templateVertices_.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        instanceVBO.data(GL_ARRAY_BUFFER, instances_.size() * sizeof(ShapeInstance), instances_.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)offsetof(ShapeInstance, offsetScale));
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)offsetof(ShapeInstance, color));
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // Draw every instance with one call, using the currently bound instanced program
+    void draw() const
+    {
+        if (instances_.empty())
+            return;
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(mode, 0, (GLsizei)(templateVertices_.size() / 3), (GLsizei)instances_.size());
+    }
+
+    // Queue the instanced draw as one packet of layer
+    void submit(RenderQueue& queue, unsigned int layer, unsigned int program) const
+    {
+        if (instances_.empty())
+            return;
+        queue.submit(layer, 0, program, VAO, mode, 0, (GLsizei)(templateVertices_.size() / 3), 0, -1, NULL,
+            (GLsizei)instances_.size());
+    }
+
+    void destroy()
+    {
+        VAO.reset();
+        templateVBO.reset();
+        instanceVBO.reset();
+    }
+
+    int instanceCount() const { return (int)instances_.size(); }
+
+    GLenum mode = GL_TRIANGLES;
+    GLVertexArray VAO;
+    GLBuffer templateVBO;
+    GLBuffer instanceVBO;
+
+private:
+    // bounds = { minX, minY, maxX, maxY }
+    static void boundsOf(const float* vertices, int vertexCount, float bounds[4])
+    {
+        bounds[0] = bounds[2] = vertices[0];
+        bounds[1] = bounds[3] = vertices[1];
+        for (int i = 1; i < vertexCount; i++)
+        {
+            float x = vertices[i * 3], y = vertices[i * 3 + 1];
+            bounds[0] = x < bounds[0] ? x : bounds[0];
+            bounds[1] = y < bounds[1] ? y : bounds[1];
+            bounds[2] = x > bounds[2] ? x : bounds[2];
+            bounds[3] = y > bounds[3] ? y : bounds[3];
+        }
+    }
+
+    std::vector<float> templateVertices_;
+    std::vector<ShapeInstance> instances_;
+};
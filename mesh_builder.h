@@ -0,0 +1,403 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_objects.h"
+#include "render_queue.h"
+#include "scene_batch.h"
+
+// Vertices are welded when all three coordinates have the same bits
+struct WeldKey
+{
+    uint32_t bits[3];
+
+    bool operator==(const WeldKey& other) const
+    {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct WeldKeyHash
+{
+    size_t operator()(const WeldKey& key) const
+    {
+        uint64_t hash = key.bits[0] * 0x9E3779B97F4A7C15ull;
+        hash = (hash ^ key.bits[1]) * 0xC2B2AE3D27D4EB4Full;
+        hash = (hash ^ key.bits[2]) * 0x165667B19E3779F9ull;
+        return (size_t)(hash ^ (hash >> 32));
+    }
+};
+
+// Vertices a FIFO post-transform cache of cacheSize entries has to transform for a
+// triangle list
+inline size_t vertexCacheMisses(const uint32_t* indices, size_t indexCount, int vertexCount, int cacheSize = 16)
+{
+    // a vertex is in the FIFO while fewer than cacheSize misses happened since it entered
+    std::vector<int64_t> enteredAt(vertexCount, -(int64_t)cacheSize - 1);
+    int64_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t v = indices[i];
+        if (misses - enteredAt[v] >= cacheSize)
+        {
+            enteredAt[v] = misses;
+            misses++;
+        }
+    }
+    return (size_t)misses;
+}
+
+// Average cache miss ratio (ACMR): misses per triangle, from about 0.5 (ideal for big
+// grids) up to 3 (no reuse at all)
+inline float vertexCacheMissRatio(const uint32_t* indices, size_t indexCount, int vertexCount, int cacheSize = 16)
+{
+    if (indexCount < 3)
+        return 0.0f;
+    return (float)vertexCacheMisses(indices, indexCount, vertexCount, cacheSize) / (indexCount / 3);
+}
+
+// Reorder a triangle list for the post-transform vertex cache with Tipsify (Sander,
+// Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw", 2007): emit every remaining triangle around a fanning vertex, then move on
+// to a neighbour that will still be in the cache, or back along a dead-end stack. It is
+// linear in the triangle count. Indices refer to vertices [0, vertexCount).
+inline void optimizeVertexCache(uint32_t* indices, size_t indexCount, int vertexCount, int cacheSize = 16)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // triangles around each vertex, as offsets into one shared list
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacencyStart[indices[i] + 1]++;
+    for (int v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<int> live(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        live[v] = (int)(adjacencyStart[v + 1] - adjacencyStart[v]);
+    std::vector<int> cacheTime(vertexCount, 0);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    int time = cacheSize + 1;
+    int cursor = 0;
+    int fanning = 0;
+    while (live[fanning] == 0 && fanning + 1 < vertexCount)
+        fanning++;
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        for (uint32_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++)
+        {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[triangle * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[triangle] = 1;
+        }
+
+        // next fanning vertex: the candidate that stays in the cache longest while its
+        // remaining triangles are emitted
+        int best = -1, bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (live[v] <= 0)
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                best = (int)v;
+                bestPriority = priority;
+            }
+        }
+        if (best < 0)
+        {
+            // dead end: recently used vertices first, then a sweep over all of them
+            while (!deadEnd.empty() && best < 0)
+            {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    best = (int)v;
+            }
+            while (best < 0 && cursor < vertexCount)
+            {
+                if (live[cursor] > 0)
+                    best = cursor;
+                cursor++;
+            }
+        }
+        fanning = best;
+    }
+
+    std::memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+// What indexing did to a batch
+struct IndexStats
+{
+    size_t unindexedVertices = 0;
+    size_t weldedVertices = 0;
+    size_t indexCount = 0;
+    size_t unindexedBytes = 0;
+    size_t indexedBytes = 0;    // vertices plus indices
+    float missRatioUnindexed = 0.0f;
+    float missRatioWelded = 0.0f;
+    float missRatioOptimized = 0.0f;
+};
+
+// One indexed draw: a range of the index buffer, with the batch's color it is filled with
+struct IndexedRange
+{
+    GLenum mode;
+    GLsizei count;
+    GLuint firstIndex;
+    int color;
+};
+
+// An indexed copy of a SceneBatch for drawing with the flat color program. Identical
+// vertices are welded across the whole scene, so corners that neighbouring shapes
+// repeat are stored and transformed once. Consecutive shapes that the batch would draw
+// with one merged call become one index range, and triangle ranges are reordered for
+// the post-transform cache. Vertices are then renumbered in the order the indices first
+// use them, which keeps vertex fetches sequential. Indices are 16-bit when they fit.
+class IndexedBatch
+{
+public:
+    void build(const SceneBatch& batch, int cacheSize = 16)
+    {
+        const std::vector<float>& source = batch.vertices();
+        vertices_.clear();
+        indices_.clear();
+        ranges_.clear();
+        colors_ = batch.colors();
+        stats = IndexStats();
+
+        std::unordered_map<WeldKey, uint32_t, WeldKeyHash> welded;
+        welded.reserve(source.size() / 3);
+        for (const BatchShape& shape : batch.shapes())
+        {
+            bool mergeable = shape.mode == GL_TRIANGLES || shape.mode == GL_LINES || shape.mode == GL_POINTS;
+            if (ranges_.empty() || !mergeable || ranges_.back().mode != shape.mode || ranges_.back().color != shape.color)
+            {
+                IndexedRange range = { shape.mode, 0, (GLuint)indices_.size(), shape.color };
+                ranges_.push_back(range);
+            }
+            for (GLsizei i = 0; i < shape.count; i++)
+            {
+                const float* vertex = &source[(shape.first + i) * 3];
+                WeldKey key;
+                std::memcpy(key.bits, vertex, sizeof(key.bits));
+                auto found = welded.insert(std::make_pair(key, (uint32_t)(vertices_.size() / 3)));
+                if (found.second)
+                    vertices_.insert(vertices_.end(), vertex, vertex + 3);
+                indices_.push_back(found.first->second);
+            }
+            ranges_.back().count += shape.count;
+        }
+        int vertexCount = (int)(vertices_.size() / 3);
+
+        // cache behaviour of the triangle ranges, unindexed (every vertex a miss), as
+        // welded and after reordering
+        size_t triangleIndices = 0, weldedMisses = 0, optimizedMisses = 0;
+        std::vector<uint32_t> local;
+        std::vector<int> localOf(vertexCount, -1);
+        std::vector<uint32_t> globalOf;
+        for (const IndexedRange& range : ranges_)
+        {
+            if (range.mode != GL_TRIANGLES)
+                continue;
+            uint32_t* indices = &indices_[range.firstIndex];
+
+            // number the range's vertices locally so the optimizer works on the range alone
+            local.resize(range.count);
+            globalOf.clear();
+            for (GLsizei i = 0; i < range.count; i++)
+            {
+                if (localOf[indices[i]] < 0)
+                {
+                    localOf[indices[i]] = (int)globalOf.size();
+                    globalOf.push_back(indices[i]);
+                }
+                local[i] = (uint32_t)localOf[indices[i]];
+            }
+            int localCount = (int)globalOf.size();
+
+            triangleIndices += range.count;
+            weldedMisses += vertexCacheMisses(local.data(), local.size(), localCount, cacheSize);
+            optimizeVertexCache(local.data(), local.size(), localCount, cacheSize);
+            optimizedMisses += vertexCacheMisses(local.data(), local.size(), localCount, cacheSize);
+
+            for (GLsizei i = 0; i < range.count; i++)
+                indices[i] = globalOf[local[i]];
+            for (uint32_t v : globalOf)
+                localOf[v] = -1;
+        }
+
+        // renumber vertices by first use
+        std::vector<int> renumbered(vertexCount, -1);
+        std::vector<float> ordered;
+        ordered.reserve(vertices_.size());
+        for (uint32_t& index : indices_)
+        {
+            if (renumbered[index] < 0)
+            {
+                renumbered[index] = (int)(ordered.size() / 3);
+                ordered.insert(ordered.end(), &vertices_[index * 3], &vertices_[index * 3] + 3);
+            }
+            index = (uint32_t)renumbered[index];
+        }
+        vertices_.swap(ordered);
+
+        stats.unindexedVertices = source.size() / 3;
+        stats.weldedVertices = vertices_.size() / 3;
+        stats.indexCount = indices_.size();
+        stats.unindexedBytes = source.size() * sizeof(float);
+        stats.indexedBytes = vertices_.size() * sizeof(float) + indices_.size() * indexSize();
+        if (triangleIndices > 0)
+        {
+            size_t triangles = triangleIndices / 3;
+            stats.missRatioUnindexed = 3.0f;
+            stats.missRatioWelded = (float)weldedMisses / triangles;
+            stats.missRatioOptimized = (float)optimizedMisses / triangles;
+        }
+    }
+
+    // Create the VAO with the vertex and index buffers
+    void upload()
+    {
+        VAO.create();
+        glBindVertexArray(VAO);
+        VBO.data(GL_ARRAY_BUFFER, vertices_.size() * sizeof(float), vertices_.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        if (indexType() == GL_UNSIGNED_SHORT)
+        {
+            std::vector<uint16_t> shortIndices(indices_.begin(), indices_.end());
+            EBO.data(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+            EBO.data(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(uint32_t), indices_.data(), GL_STATIC_DRAW);
+
+        // the element buffer binding belongs to the VAO, so it stays bound until the VAO is unbound
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    // Draw every range with the currently bound flat color program, setting the color
+    // uniform only when it changes
+    void draw(GLint colorLocation) const
+    {
+        glBindVertexArray(VAO);
+        GLenum type = indexType();
+        size_t size = indexSize();
+        int currentColor = -1;
+        for (const IndexedRange& range : ranges_)
+        {
+            if (range.color != currentColor)
+            {
+                glUniform4fv(colorLocation, 1, &colors_[range.color * 4]);
+                currentColor = range.color;
+            }
+            glDrawElements(range.mode, range.count, type, (void*)(range.firstIndex * size));
+        }
+    }
+
+    // Queue every range as a draw packet of layer; depth keeps range order
+    void submit(RenderQueue& queue, unsigned int layer, unsigned int program, GLint colorLocation) const
+    {
+        GLenum type = indexType();
+        for (size_t i = 0; i < ranges_.size(); i++)
+        {
+            const IndexedRange& range = ranges_[i];
+            queue.submit(layer, (unsigned int)i, program, VAO, range.mode, (GLint)range.firstIndex, range.count, type,
+                colorLocation, &colors_[range.color * 4]);
+        }
+    }
+
+    // Queue only the listed ranges, e.g. the ones a culling pass found visible; depth
+    // still keeps range order whatever order the list is in
+    void submit(RenderQueue& queue, unsigned int layer, unsigned int program, GLint colorLocation,
+        const std::vector<int>& visibleRanges) const
+    {
+        GLenum type = indexType();
+        for (int i : visibleRanges)
+        {
+            const IndexedRange& range = ranges_[i];
+            queue.submit(layer, (unsigned int)i, program, VAO, range.mode, (GLint)range.firstIndex, range.count, type,
+                colorLocation, &colors_[range.color * 4]);
+        }
+    }
+
+    // Bounding box (minX, minY, maxX, maxY) of a range's vertices
+    void rangeBounds(int index, float* box) const
+    {
+        const IndexedRange& range = ranges_[index];
+        box[0] = box[1] = 1e30f;
+        box[2] = box[3] = -1e30f;
+        for (GLsizei i = 0; i < range.count; i++)
+        {
+            const float* vertex = &vertices_[indices_[range.firstIndex + i] * 3];
+            box[0] = std::min(box[0], vertex[0]);
+            box[1] = std::min(box[1], vertex[1]);
+            box[2] = std::max(box[2], vertex[0]);
+            box[3] = std::max(box[3], vertex[1]);
+        }
+    }
+
+    void destroy()
+    {
+        VAO.reset();
+        VBO.reset();
+        EBO.reset();
+    }
+
+    int rangeCount() const { return (int)ranges_.size(); }
+    const std::vector<float>& vertices() const { return vertices_; }
+    const std::vector<uint32_t>& indices() const { return indices_; }
+    const std::vector<IndexedRange>& ranges() const { return ranges_; }
+
+    IndexStats stats;
+
+    GLVertexArray VAO;
+    GLBuffer VBO;
+    GLBuffer EBO;
+
+private:
+    GLenum indexType() const { return vertices_.size() / 3 <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+    size_t indexSize() const { return indexType() == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+    std::vector<float> vertices_;
+    std::vector<uint32_t> indices_;
+    std::vector<IndexedRange> ranges_;
+    std::vector<float> colors_;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <vector>
+
+// Write tightly packed RGBA pixels as a binary PPM. GL rows start at the bottom,
+// so they are flipped on the way out.
+inline bool writePPM(const char* path, int width, int height, const unsigned char* rgba)
+{
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+        return false;
+
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(width * 3);
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const unsigned char* src = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        std::fwrite(row.data(), 1, row.size(), file);
+    }
+    return std::fclose(file) == 0;
+}
+
+// Framebuffer object with a single RGBA8 color renderbuffer, used to render without a
+// visible window (headless batch jobs, CI). Works on any GL 3.3 driver, including
+// Mesa llvmpipe.
+class OffscreenTarget
+{
+public:
+    bool create(int targetWidth, int targetHeight)
+    {
+        width = targetWidth;
+        height = targetHeight;
+
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &colorRBO);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    }
+
+    // Make this the draw and read target and cover it with the viewport
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+    // Synchronous readback of the whole target as RGBA8
+    void readPixels(std::vector<unsigned char>& rgba) const
+    {
+        rgba.resize((size_t)width * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &colorRBO);
+        FBO = 0;
+        colorRBO = 0;
+    }
+
+    unsigned int FBO = 0;
+    unsigned int colorRBO = 0;
+    int width = 0;
+    int height = 0;
+};
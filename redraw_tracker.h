@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+// Decides whether a frame needs drawing at all, and which part of it, for render loops
+// that only redraw on demand.
+//
+// Anything that changes the picture marks it: markAll() for changes that touch every
+// pixel (the first frame, a resize, the window being uncovered), mark() with a pixel
+// rectangle for ones that stay local (an object moving from one place to another). A
+// frame is drawn while the tracker is dirty, with the scissor box set to the damaged
+// rectangle when only part of it changed; rendered() then starts collecting damage for
+// the next one. Iterations that find nothing to draw call skipped().
+class RedrawTracker
+{
+public:
+    void markAll()
+    {
+        dirty_ = true;
+        full_ = true;
+    }
+
+    // Damage pixels [minX, maxX) x [minY, maxY), bottom-up like glScissor
+    void mark(int minX, int minY, int maxX, int maxY)
+    {
+        if (minX >= maxX || minY >= maxY)
+            return;
+        if (!dirty_)
+        {
+            minX_ = minX;
+            minY_ = minY;
+            maxX_ = maxX;
+            maxY_ = maxY;
+        }
+        else
+        {
+            minX_ = std::min(minX_, minX);
+            minY_ = std::min(minY_, minY);
+            maxX_ = std::max(maxX_, maxX);
+            maxY_ = std::max(maxY_, maxY);
+        }
+        dirty_ = true;
+    }
+
+    bool dirty() const { return dirty_; }
+
+    // Limit drawing to the damage of a width x height target: the scissor box when only
+    // part of it changed, nothing when all of it did. Undo with endScissor().
+    void beginScissor(int width, int height)
+    {
+        int minX = std::max(minX_, 0), minY = std::max(minY_, 0);
+        int maxX = std::min(maxX_, width), maxY = std::min(maxY_, height);
+        if (full_ || (minX == 0 && minY == 0 && maxX == width && maxY == height))
+            return;
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(minX, minY, std::max(maxX - minX, 0), std::max(maxY - minY, 0));
+        damagedPixels_ += (long long)std::max(maxX - minX, 0) * std::max(maxY - minY, 0);
+        partialFrames_++;
+    }
+
+    void endScissor() { glDisable(GL_SCISSOR_TEST); }
+
+    void rendered()
+    {
+        framesRendered_++;
+        dirty_ = false;
+        full_ = false;
+    }
+
+    void skipped() { framesSkipped_++; }
+
+    int framesRendered() const { return framesRendered_; }
+    int framesSkipped() const { return framesSkipped_; }
+
+    // How many frames were drawn with a scissor box, and the pixels they covered
+    int partialFrames() const { return partialFrames_; }
+    long long damagedPixels() const { return damagedPixels_; }
+
+private:
+    bool dirty_ = true;
+    bool full_ = true;
+    int minX_ = 0, minY_ = 0, maxX_ = 0, maxY_ = 0;
+
+    int framesRendered_ = 0;
+    int framesSkipped_ = 0;
+    int partialFrames_ = 0;
+    long long damagedPixels_ = 0;
+};
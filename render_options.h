@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Command line switches shared by the render programs
+struct RenderOptions
+{
+    // render into an offscreen framebuffer of an invisible window, then exit
+    bool headless = false;
+    int frameCount = 1;
+    std::string outputPath = "frame.ppm";
+
+    // directory to record every frame into as a PPM sequence; empty when not recording
+    std::string captureDirectory;
+
+    // per-frame timings are written here, as JSON if the name ends in .json, CSV otherwise
+    std::string profilePath;
+
+    // scene to load instead of the built-in one (text or binary form), and where to save
+    // the scene in binary form
+    std::string scenePath;
+    std::string writeScenePath;
+
+    // draw with the CPU rasterizer into this PPM instead of using GL; empty for GL.
+    // It uses softwareThreads threads, 0 meaning one per core.
+    std::string softwarePath;
+    int softwareThreads = 0;
+
+    // animate vertex positions every frame through a streaming buffer instead of
+    // drawing static geometry
+    bool dynamicGeometry = false;
+
+    // frame rate: vsync (the default), uncapped, or paced to targetFps; the simulation
+    // runs at simulationRate steps per second regardless
+    bool vsync = true;
+    int targetFps = 0;
+    int simulationRate = 120;
+
+    // only draw a frame when something changed, waiting for events in between; with
+    // damageRegions only the changed part of the frame is redrawn
+    bool renderOnDemand = false;
+    bool damageRegions = false;
+
+    // prepare each frame on a worker thread while the GL thread draws the previous one
+    bool threaded = false;
+
+    // draw the scene from 8-byte vertices (quantized positions, RGBA8 colors) instead
+    // of 12-byte float ones
+    bool compactVertices = false;
+};
+
+inline RenderOptions parseRenderOptions(int argc, char** argv)
+{
+    RenderOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(arg, "--headless") == 0)
+            options.headless = true;
+        else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+            options.frameCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--output") == 0 && hasValue)
+            options.outputPath = argv[++i];
+        else if (std::strcmp(arg, "--capture") == 0 && hasValue)
+            options.captureDirectory = argv[++i];
+        else if (std::strcmp(arg, "--profile") == 0 && hasValue)
+            options.profilePath = argv[++i];
+        else if (std::strcmp(arg, "--scene") == 0 && hasValue)
+            options.scenePath = argv[++i];
+        else if (std::strcmp(arg, "--write-scene") == 0 && hasValue)
+            options.writeScenePath = argv[++i];
+        else if (std::strcmp(arg, "--software") == 0 && hasValue)
+            options.softwarePath = argv[++i];
+        else if (std::strcmp(arg, "--threads") == 0 && hasValue)
+            options.softwareThreads = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--dynamic") == 0)
+            options.dynamicGeometry = true;
+        else if (std::strcmp(arg, "--fps") == 0 && hasValue)
+        {
+            const char* mode = argv[++i];
+            options.vsync = std::strcmp(mode, "vsync") == 0;
+            options.targetFps = options.vsync || std::strcmp(mode, "uncapped") == 0 ? 0 : std::max(1, std::atoi(mode));
+        }
+        else if (std::strcmp(arg, "--tick-rate") == 0 && hasValue)
+            options.simulationRate = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--on-demand") == 0)
+            options.renderOnDemand = true;
+        else if (std::strcmp(arg, "--damage") == 0)
+            options.renderOnDemand = options.damageRegions = true;
+        else if (std::strcmp(arg, "--threaded") == 0)
+            options.threaded = true;
+        else if (std::strcmp(arg, "--compact") == 0)
+            options.compactVertices = true;
+        else
+            std::cerr << "Ignoring unknown option " << arg << std::endl;
+    }
+    return options;
+}
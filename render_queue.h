@@ -0,0 +1,240 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Shadow copy of the GL state the render queue changes: the bound program, the bound
+// VAO and vec4 color uniforms. A change that matches the shadow is not sent to GL.
+// Code that changes these behind the cache's back must call invalidate().
+class GLStateCache
+{
+public:
+    void useProgram(unsigned int program)
+    {
+        requested_++;
+        if (program == program_)
+            return;
+        glUseProgram(program);
+        program_ = program;
+        issued_++;
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        requested_++;
+        if (vao == vao_)
+            return;
+        glBindVertexArray(vao);
+        vao_ = vao;
+        issued_++;
+    }
+
+    // Set a vec4 uniform of the bound program; uniforms live in their program, so the
+    // shadow is kept per program and location
+    void setColor(GLint location, const float* rgba)
+    {
+        requested_++;
+        for (ColorUniform& uniform : colors_)
+        {
+            if (uniform.program == program_ && uniform.location == location)
+            {
+                if (std::memcmp(uniform.rgba, rgba, sizeof(uniform.rgba)) == 0)
+                    return;
+                std::memcpy(uniform.rgba, rgba, sizeof(uniform.rgba));
+                glUniform4fv(location, 1, rgba);
+                issued_++;
+                return;
+            }
+        }
+        ColorUniform uniform;
+        uniform.program = program_;
+        uniform.location = location;
+        std::memcpy(uniform.rgba, rgba, sizeof(uniform.rgba));
+        colors_.push_back(uniform);
+        glUniform4fv(location, 1, rgba);
+        issued_++;
+    }
+
+    // Forget everything, e.g. after other code bound programs or VAOs itself
+    void invalidate()
+    {
+        program_ = unknown;
+        vao_ = unknown;
+        colors_.clear();
+    }
+
+    // State changes asked for and actually sent since the last resetCounts()
+    long long requested() const { return requested_; }
+    long long issued() const { return issued_; }
+    long long avoided() const { return requested_ - issued_; }
+
+    void resetCounts()
+    {
+        requested_ = 0;
+        issued_ = 0;
+    }
+
+private:
+    static const unsigned int unknown = 0xFFFFFFFFu;
+
+    struct ColorUniform
+    {
+        unsigned int program;
+        GLint location;
+        float rgba[4];
+    };
+
+    unsigned int program_ = unknown;
+    unsigned int vao_ = unknown;
+    std::vector<ColorUniform> colors_;
+    long long requested_ = 0;
+    long long issued_ = 0;
+};
+
+// One draw call with the state it needs
+struct DrawPacket
+{
+    uint64_t key;
+    unsigned int program;
+    unsigned int vao;
+    GLenum mode;
+    GLint first;                // first vertex, or first index with an index type
+    GLsizei count;
+    GLenum indexType;           // 0 for glDrawArrays
+    GLsizei instanceCount;      // 0 for a plain draw
+    GLint colorLocation;        // -1 when the packet sets no color
+    const float* color;         // must stay valid until the queue is executed
+};
+
+// Draw calls collected during a frame, sorted by their key and then executed with as
+// few state changes as possible.
+//
+// The key orders packets by layer first, then program, then VAO, then depth. Layers
+// keep content that must stay in painter's order apart (everything in layer 1 covers
+// layer 0); within a layer, draws are grouped by program and VAO so each is bound once.
+// Depth orders draws of the same program and VAO, and the sort is stable, so packets
+// with equal keys keep the order they were submitted in.
+//
+// Key layout, high to low: layer 8 bits, program 16, VAO 16, depth 24. Layers, programs
+// and VAOs past their bits assert in debug builds; in release builds they alias smaller
+// values, which only costs state-change grouping (the state cache binds the real names).
+// Larger depths assert too and are clamped to maxDepth otherwise, so they sort after
+// everything below the limit and among themselves in submission order instead of
+// wrapping around to the front.
+class RenderQueue
+{
+public:
+    static const unsigned int maxDepth = 0xFFFFFF;
+
+    static uint64_t makeKey(unsigned int layer, unsigned int program, unsigned int vao, unsigned int depth)
+    {
+        assert(layer <= 0xFF && "render queue layer past 8 bits");
+        assert(program <= 0xFFFF && vao <= 0xFFFF && "GL name past the 16 bits of the render queue key");
+        assert(depth <= maxDepth && "render queue depth past 24 bits");
+        return (uint64_t)(layer & 0xFF) << 56 | (uint64_t)(program & 0xFFFF) << 40
+            | (uint64_t)(vao & 0xFFFF) << 24 | (depth < maxDepth ? depth : maxDepth);
+    }
+
+    void clear() { packets_.clear(); }
+
+    void submit(const DrawPacket& packet) { packets_.push_back(packet); }
+
+    // Draw arrays (or, with an index type, elements) of a VAO with a program, optionally
+    // setting a color uniform first
+    void submit(unsigned int layer, unsigned int depth, unsigned int program, unsigned int vao, GLenum mode,
+        GLint first, GLsizei count, GLenum indexType = 0, GLint colorLocation = -1, const float* color = NULL,
+        GLsizei instanceCount = 0)
+    {
+        DrawPacket packet;
+        packet.key = makeKey(layer, program, vao, depth);
+        packet.program = program;
+        packet.vao = vao;
+        packet.mode = mode;
+        packet.first = first;
+        packet.count = count;
+        packet.indexType = indexType;
+        packet.instanceCount = instanceCount;
+        packet.colorLocation = colorLocation;
+        packet.color = color;
+        packets_.push_back(packet);
+    }
+
+    // Stable LSD radix sort of the packets by key, a byte per pass; passes where every
+    // key has the same byte are skipped, so the usual handful of distinct programs and
+    // VAOs costs few passes
+    void sort()
+    {
+        size_t count = packets_.size();
+        order_.resize(count);
+        scratch_.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            order_[i].key = packets_[i].key;
+            order_[i].index = (uint32_t)i;
+        }
+
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for (const SortItem& item : order_)
+                offsets[(item.key >> shift) & 0xFF]++;
+            if (count == 0 || offsets[(order_[0].key >> shift) & 0xFF] == count)
+                continue;
+
+            size_t total = 0;
+            for (int digit = 0; digit < 256; digit++)
+            {
+                size_t digitCount = offsets[digit];
+                offsets[digit] = total;
+                total += digitCount;
+            }
+            for (const SortItem& item : order_)
+                scratch_[offsets[(item.key >> shift) & 0xFF]++] = item;
+            order_.swap(scratch_);
+        }
+    }
+
+    // Issue every packet in sorted order (call sort() first)
+    void execute(GLStateCache& state) const
+    {
+        for (const SortItem& item : order_)
+        {
+            const DrawPacket& packet = packets_[item.index];
+            state.useProgram(packet.program);
+            state.bindVertexArray(packet.vao);
+            if (packet.color && packet.colorLocation >= 0)
+                state.setColor(packet.colorLocation, packet.color);
+
+            if (packet.indexType != 0)
+            {
+                size_t indexSize = packet.indexType == GL_UNSIGNED_SHORT ? 2 : packet.indexType == GL_UNSIGNED_BYTE ? 1 : 4;
+                const void* offset = (const void*)(packet.first * indexSize);
+                if (packet.instanceCount > 0)
+                    glDrawElementsInstanced(packet.mode, packet.count, packet.indexType, offset, packet.instanceCount);
+                else
+                    glDrawElements(packet.mode, packet.count, packet.indexType, offset);
+            }
+            else if (packet.instanceCount > 0)
+                glDrawArraysInstanced(packet.mode, packet.first, packet.count, packet.instanceCount);
+            else
+                glDrawArrays(packet.mode, packet.first, packet.count);
+        }
+    }
+
+    size_t packetCount() const { return packets_.size(); }
+
+private:
+    struct SortItem
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DrawPacket> packets_;
+    std::vector<SortItem> order_;
+    std::vector<SortItem> scratch_;
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "gl_objects.h"
+#include "render_queue.h"
+
+// One shape inside the shared vertex buffer: how to draw it, which vertices it uses
+// and which entry of the batch's color table it is filled with
+struct BatchShape
+{
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+    int color;
+};
+
+// the binary scene format stores shape records in exactly this layout
+static_assert(sizeof(BatchShape) == 16, "BatchShape must stay four 32-bit fields");
+
+// Packs every shape of a scene into a single VAO/VBO so that runs of shapes can be
+// submitted with one glDrawArrays/glMultiDrawArrays instead of one bind + draw each.
+// Vertices are x, y, z floats, the same layout every per-shape VBO used. Colors are
+// applied through a vec4 uniform of the flat color program.
+class SceneBatch
+{
+public:
+    // Add an RGBA color to the color table and return its index; a color that is
+    // already in the table is shared
+    int addColor(const float* rgba)
+    {
+        for (size_t i = 0; i < colors_.size(); i += 4)
+        {
+            if (colors_[i] == rgba[0] && colors_[i + 1] == rgba[1] && colors_[i + 2] == rgba[2] && colors_[i + 3] == rgba[3])
+                return (int)(i / 4);
+        }
+        colors_.insert(colors_.end(), rgba, rgba + 4);
+        return (int)(colors_.size() / 4) - 1;
+    }
+
+    // Copy a shape into the batch and return its index
+    int addShape(GLenum mode, int color, const float* vertices, int vertexCount)
+    {
+        BatchShape shape;
+        shape.mode = mode;
+        shape.first = (GLint)(vertices_.size() / 3);
+        shape.count = vertexCount;
+        shape.color = color;
+        vertices_.insert(vertices_.end(), vertices, vertices + vertexCount * 3);
+        shapes_.push_back(shape);
+        return (int)shapes_.size() - 1;
+    }
+
+    template <std::size_t N>
+    int addShape(GLenum mode, int color, const float (&vertices)[N])
+    {
+        return addShape(mode, color, vertices, (int)(N / 3));
+    }
+
+    // Append every shape of another (not mapped) batch after the shapes of this one
+    void append(const SceneBatch& other)
+    {
+        for (const BatchShape& shape : other.shapes_)
+        {
+            int color = addColor(&other.colors_[shape.color * 4]);
+            addShape(shape.mode, color, &other.vertices_[shape.first * 3], shape.count);
+        }
+    }
+
+    // Replace the shape and color tables wholesale, e.g. with tables read from a scene file,
+    // along with the vertices when the caller wants the batch to keep a copy of them
+    void assign(const BatchShape* shapes, int shapeCount, const float* colors, int colorCount,
+        const float* vertices = NULL, size_t vertexCount = 0)
+    {
+        shapes_.assign(shapes, shapes + shapeCount);
+        colors_.assign(colors, colors + colorCount * 4);
+        vertices_.assign(vertices, vertices + vertexCount * 3);
+    }
+
+    // Create the VAO and upload all vertices in one glBufferData call
+    void upload()
+    {
+        upload(vertices_.data(), vertices_.size() / 3);
+    }
+
+    // Upload vertices that live outside the batch (a memory-mapped scene file, say)
+    // straight into the VBO
+    void upload(const float* vertices, size_t vertexCount)
+    {
+        VAO.create();
+        glBindVertexArray(VAO);
+        VBO.data(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(float), vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // Draw shapes [firstShape, firstShape + shapeCount) with the currently bound flat color
+    // program. Neighbouring shapes with the same primitive mode and color go out as one
+    // multi-draw; adjacent list primitives (triangles, lines, points) are merged into a
+    // single range. The color uniform is only set when it changes.
+    void draw(GLint colorLocation, int firstShape, int shapeCount) const
+    {
+        glBindVertexArray(VAO);
+
+        int end = firstShape + shapeCount;
+        int i = firstShape;
+        int currentColor = -1;
+        while (i < end)
+        {
+            GLenum mode = shapes_[i].mode;
+            int color = shapes_[i].color;
+            bool mergeable = mode == GL_TRIANGLES || mode == GL_LINES || mode == GL_POINTS;
+
+            if (color != currentColor)
+            {
+                glUniform4fv(colorLocation, 1, &colors_[color * 4]);
+                currentColor = color;
+            }
+
+            runFirsts_.clear();
+            runCounts_.clear();
+            for (; i < end && shapes_[i].mode == mode && shapes_[i].color == color; i++)
+            {
+                const BatchShape& shape = shapes_[i];
+                if (mergeable && !runFirsts_.empty() && runFirsts_.back() + runCounts_.back() == shape.first)
+                    runCounts_.back() += shape.count;
+                else
+                {
+                    runFirsts_.push_back(shape.first);
+                    runCounts_.push_back(shape.count);
+                }
+            }
+
+            if (runFirsts_.size() == 1)
+                glDrawArrays(mode, runFirsts_[0], runCounts_[0]);
+            else
+                glMultiDrawArrays(mode, runFirsts_.data(), runCounts_.data(), (GLsizei)runFirsts_.size());
+        }
+    }
+
+    void draw(GLint colorLocation) const
+    {
+        draw(colorLocation, 0, (int)shapes_.size());
+    }
+
+    // Queue every shape as a draw packet of layer with the flat color program; adjacent
+    // list primitives of one color are merged as in draw(), and depth keeps shape order
+    void submit(RenderQueue& queue, unsigned int layer, unsigned int program, GLint colorLocation) const
+    {
+        for (size_t i = 0; i < shapes_.size(); )
+        {
+            const BatchShape& shape = shapes_[i];
+            bool mergeable = shape.mode == GL_TRIANGLES || shape.mode == GL_LINES || shape.mode == GL_POINTS;
+            GLsizei count = shape.count;
+            size_t next = i + 1;
+            for (; mergeable && next < shapes_.size(); next++)
+            {
+                const BatchShape& following = shapes_[next];
+                if (following.mode != shape.mode || following.color != shape.color || following.first != shape.first + count)
+                    break;
+                count += following.count;
+            }
+            queue.submit(layer, (unsigned int)i, program, VAO, shape.mode, shape.first, count, 0, colorLocation,
+                &colors_[shape.color * 4]);
+            i = next;
+        }
+    }
+
+    void destroy()
+    {
+        VAO.reset();
+        VBO.reset();
+    }
+
+    int shapeCount() const { return (int)shapes_.size(); }
+    const BatchShape& shape(int index) const { return shapes_[index]; }
+    const std::vector<BatchShape>& shapes() const { return shapes_; }
+    const std::vector<float>& vertices() const { return vertices_; }
+    const std::vector<float>& colors() const { return colors_; }
+
+    GLVertexArray VAO;
+    GLBuffer VBO;
+
+private:
+    std::vector<float> vertices_;
+    std::vector<BatchShape> shapes_;
+    std::vector<float> colors_;
+
+    // scratch space reused by draw() so the render loop does not allocate
+    mutable std::vector<GLint> runFirsts_;
+    mutable std::vector<GLsizei> runCounts_;
+};
@@ -0,0 +1,455 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "scene_batch.h"
+#include "tessellate.h"
+
+// Scenes come in two forms.
+//
+// Text, for authoring:
+//
+//     # comment
+//     color window 0 0 0 1
+//     shape triangles window
+//     0.45 0.26
+//     0.45 0.11 0.0
+//     ...
+//
+// "color" names an RGBA color, "shape" starts a shape with a primitive mode (points,
+// lines, line_strip, line_loop, triangles, triangle_strip, triangle_fan) and a color,
+// and every following line of numbers is one vertex (z defaults to 0).
+//
+// Curves and outlines are triangulated on load (see tessellate.h), finely enough for
+// the given pixel error:
+//
+//     circle <color> cx cy r                       (round on screen, r along x)
+//     ellipse <color> cx cy rx ry
+//     arc <color> cx cy rx ry start sweep          (a pie slice, angles in degrees)
+//     polygon <color>                              (followed by its outline's vertices)
+//
+// Binary, for loading: a SceneFileHeader, the shape table (BatchShape records), the
+// color table (4 floats each) and one contiguous blob of x, y, z vertices. The loader
+// maps the file and hands the vertex blob to glBufferData as is, so load time does not
+// grow with the number of shapes beyond copying their 16-byte records.
+
+struct SceneFileHeader
+{
+    char magic[4];          // "SCNB"
+    uint32_t version;
+    uint32_t shapeCount;
+    uint32_t colorCount;
+    uint32_t vertexCount;
+    uint32_t shapeOffset;   // byte offsets from the start of the file
+    uint32_t colorOffset;
+    uint32_t vertexOffset;
+};
+
+const uint32_t sceneFileVersion = 1;
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    ~MappedFile() { close(); }
+
+    bool open(const char* path)
+    {
+#ifdef _WIN32
+        file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_ == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file_, &fileSize);
+        size = (size_t)fileSize.QuadPart;
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_ == NULL)
+            return false;
+        data = (const unsigned char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+        fd_ = ::open(path, O_RDONLY);
+        if (fd_ < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd_, &info) != 0 || info.st_size == 0)
+            return false;
+        size = (size_t)info.st_size;
+        void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        data = mapped == MAP_FAILED ? NULL : (const unsigned char*)mapped;
+#endif
+        return data != NULL;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping_)
+            CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+        mapping_ = NULL;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void*)data, size);
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const unsigned char* data = NULL;
+    size_t size = 0;
+
+private:
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+#else
+    int fd_ = -1;
+#endif
+};
+
+inline bool parsePrimitiveMode(const std::string& name, GLenum& mode)
+{
+    static const std::map<std::string, GLenum> modes = {
+        { "points", GL_POINTS },
+        { "lines", GL_LINES },
+        { "line_strip", GL_LINE_STRIP },
+        { "line_loop", GL_LINE_LOOP },
+        { "triangles", GL_TRIANGLES },
+        { "triangle_strip", GL_TRIANGLE_STRIP },
+        { "triangle_fan", GL_TRIANGLE_FAN },
+    };
+    auto found = modes.find(name);
+    if (found == modes.end())
+        return false;
+    mode = found->second;
+    return true;
+}
+
+// Whether count vertices make whole primitives of a list mode: batches merge neighbouring
+// list shapes into one draw, so leftover vertices would join the next shape's
+inline bool wholePrimitives(GLenum mode, int64_t count)
+{
+    if (mode == GL_TRIANGLES)
+        return count % 3 == 0;
+    if (mode == GL_LINES)
+        return count % 2 == 0;
+    return true;
+}
+
+// Parse a text scene into batch (without uploading it)
+inline bool parseSceneText(const char* path, SceneBatch& batch,
+    const TessellationSettings& tessellation = TessellationSettings())
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Failed to open scene " << path << std::endl;
+        return false;
+    }
+
+    // Shapes are kept in file order until the end, so that all curves and polygons can
+    // be tessellated in one parallel pass; tessellated shapes refer to their job
+    struct ParsedShape
+    {
+        GLenum mode;
+        int color;
+        std::vector<float> vertices;
+        int job;
+    };
+    std::vector<ParsedShape> parsedShapes;
+    std::vector<TessellationShape> jobs;
+
+    std::map<std::string, int> colorNames;
+    std::vector<float> shapeVertices;
+    GLenum shapeMode = 0;
+    int shapeColor = -1;
+    int shapeLine = 0;
+    bool shapeIsPolygon = false;
+    auto finishShape = [&]()
+    {
+        if (shapeColor >= 0 && !shapeIsPolygon && !wholePrimitives(shapeMode, shapeVertices.size() / 3))
+        {
+            std::cerr << path << ":" << shapeLine << ": " << shapeVertices.size() / 3
+                << " vertices do not make whole primitives of the shape's mode" << std::endl;
+            return false;
+        }
+        if (shapeColor >= 0 && !shapeVertices.empty())
+        {
+            ParsedShape parsed = { shapeMode, shapeColor, std::vector<float>(), -1 };
+            if (shapeIsPolygon)
+            {
+                TessellationShape polygon;
+                polygon.kind = TessellationShape::Polygon;
+                for (size_t i = 0; i < shapeVertices.size(); i += 3)
+                {
+                    polygon.outline.push_back(shapeVertices[i]);
+                    polygon.outline.push_back(shapeVertices[i + 1]);
+                }
+                parsed.job = (int)jobs.size();
+                jobs.push_back(polygon);
+            }
+            else
+                parsed.vertices.swap(shapeVertices);
+            parsedShapes.push_back(parsed);
+        }
+        shapeVertices.clear();
+        shapeColor = -1;
+        shapeIsPolygon = false;
+        return true;
+    };
+    auto findColor = [&](const std::string& name, int lineNumber)
+    {
+        auto found = colorNames.find(name);
+        if (found == colorNames.end())
+        {
+            std::cerr << path << ":" << lineNumber << ": unknown color " << name << std::endl;
+            return -1;
+        }
+        return found->second;
+    };
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++)
+    {
+        std::istringstream fields(line);
+        std::string keyword;
+        if (!(fields >> keyword) || keyword[0] == '#')
+            continue;
+
+        if (keyword == "color")
+        {
+            std::string name;
+            float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            if (!(fields >> name >> rgba[0] >> rgba[1] >> rgba[2]))
+            {
+                std::cerr << path << ":" << lineNumber << ": expected color <name> r g b [a]" << std::endl;
+                return false;
+            }
+            fields >> rgba[3];
+            colorNames[name] = batch.addColor(rgba);
+        }
+        else if (keyword == "shape")
+        {
+            if (!finishShape())
+                return false;
+            std::string modeName, colorName;
+            fields >> modeName >> colorName;
+            if (!parsePrimitiveMode(modeName, shapeMode) || colorNames.count(colorName) == 0)
+            {
+                std::cerr << path << ":" << lineNumber << ": unknown primitive mode or color" << std::endl;
+                return false;
+            }
+            shapeColor = colorNames[colorName];
+            shapeLine = lineNumber;
+        }
+        else if (keyword == "polygon")
+        {
+            if (!finishShape())
+                return false;
+            std::string colorName;
+            fields >> colorName;
+            shapeMode = GL_TRIANGLES;
+            shapeColor = findColor(colorName, lineNumber);
+            shapeIsPolygon = true;
+            if (shapeColor < 0)
+                return false;
+        }
+        else if (keyword == "circle" || keyword == "ellipse" || keyword == "arc")
+        {
+            if (!finishShape())
+                return false;
+            std::string colorName;
+            TessellationShape curve;
+            bool valid = (bool)(fields >> colorName >> curve.cx >> curve.cy >> curve.rx);
+            if (keyword == "circle")
+                curve.ry = curve.rx * tessellation.pixelsPerUnitX / tessellation.pixelsPerUnitY;
+            else
+                valid = valid && (fields >> curve.ry);
+            if (keyword == "arc")
+            {
+                float start = 0.0f, sweep = 0.0f;
+                valid = valid && (fields >> start >> sweep);
+                curve.startAngle = start * 0.0174532925f;
+                curve.sweep = sweep * 0.0174532925f;
+            }
+            if (!valid)
+            {
+                std::cerr << path << ":" << lineNumber << ": expected " << keyword << " <color> cx cy "
+                    << (keyword == "circle" ? "r" : keyword == "ellipse" ? "rx ry" : "rx ry start sweep") << std::endl;
+                return false;
+            }
+            int color = findColor(colorName, lineNumber);
+            if (color < 0)
+                return false;
+            ParsedShape parsed = { GL_TRIANGLES, color, std::vector<float>(), (int)jobs.size() };
+            parsedShapes.push_back(parsed);
+            jobs.push_back(curve);
+        }
+        else
+        {
+            std::istringstream numbers(line);
+            float x, y, z = 0.0f;
+            if (shapeColor < 0 || !(numbers >> x >> y))
+            {
+                std::cerr << path << ":" << lineNumber << ": expected a vertex of the current shape" << std::endl;
+                return false;
+            }
+            numbers >> z;
+            shapeVertices.push_back(x);
+            shapeVertices.push_back(y);
+            shapeVertices.push_back(z);
+        }
+    }
+    if (!finishShape())
+        return false;
+
+    std::vector<TriangleMesh> meshes;
+    int notSimple = tessellateShapes(jobs, meshes, tessellation);
+    if (notSimple > 0)
+        std::cerr << path << ": " << notSimple << " polygons could not be triangulated fully (self-intersecting?)" << std::endl;
+
+    std::vector<float> expanded;
+    for (const ParsedShape& parsed : parsedShapes)
+    {
+        const std::vector<float>* vertices = &parsed.vertices;
+        if (parsed.job >= 0)
+        {
+            meshes[parsed.job].expand(expanded);
+            vertices = &expanded;
+        }
+        if (!vertices->empty())
+            batch.addShape(parsed.mode, parsed.color, vertices->data(), (int)vertices->size() / 3);
+    }
+    return true;
+}
+
+// Write batch in the binary scene form
+inline bool writeSceneBinary(const char* path, const SceneBatch& batch)
+{
+    const std::vector<BatchShape>& shapes = batch.shapes();
+    const std::vector<float>& colors = batch.colors();
+    const std::vector<float>& vertices = batch.vertices();
+
+    SceneFileHeader header;
+    std::memcpy(header.magic, "SCNB", 4);
+    header.version = sceneFileVersion;
+    header.shapeCount = (uint32_t)shapes.size();
+    header.colorCount = (uint32_t)(colors.size() / 4);
+    header.vertexCount = (uint32_t)(vertices.size() / 3);
+    header.shapeOffset = sizeof(SceneFileHeader);
+    header.colorOffset = header.shapeOffset + header.shapeCount * sizeof(BatchShape);
+    header.vertexOffset = header.colorOffset + header.colorCount * 4 * sizeof(float);
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+        return false;
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(shapes.data(), sizeof(BatchShape), shapes.size(), file);
+    std::fwrite(colors.data(), sizeof(float), colors.size(), file);
+    std::fwrite(vertices.data(), sizeof(float), vertices.size(), file);
+    return std::fclose(file) == 0;
+}
+
+// Load a binary scene by mapping it: the shape and color tables are copied into batch
+// and the vertex blob goes straight from the mapping into the GPU buffer. Without
+// upload (no GL context, e.g. the software rasterizer) the vertices are copied into
+// batch instead.
+inline bool loadSceneBinary(const char* path, SceneBatch& batch, bool upload = true)
+{
+    MappedFile file;
+    if (!file.open(path) || file.size < sizeof(SceneFileHeader))
+    {
+        std::cerr << "Failed to map scene " << path << std::endl;
+        return false;
+    }
+
+    SceneFileHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    bool valid = std::memcmp(header.magic, "SCNB", 4) == 0
+        && header.version == sceneFileVersion
+        && header.shapeOffset + (size_t)header.shapeCount * sizeof(BatchShape) <= file.size
+        && header.colorOffset + (size_t)header.colorCount * 4 * sizeof(float) <= file.size
+        && header.vertexOffset + (size_t)header.vertexCount * 3 * sizeof(float) <= file.size;
+
+    // every shape must stay inside the vertex blob and the color table, or drawing it
+    // would read past their ends, and list shapes must hold whole primitives
+    const BatchShape* shapes = (const BatchShape*)(file.data + header.shapeOffset);
+    for (uint32_t i = 0; valid && i < header.shapeCount; i++)
+    {
+        const BatchShape& shape = shapes[i];
+        valid = shape.first >= 0 && shape.count >= 0
+            && (int64_t)shape.first + shape.count <= (int64_t)header.vertexCount
+            && wholePrimitives(shape.mode, shape.count)
+            && shape.color >= 0 && (uint32_t)shape.color < header.colorCount;
+    }
+    if (!valid)
+    {
+        std::cerr << "Scene " << path << " is not a version " << sceneFileVersion << " binary scene" << std::endl;
+        return false;
+    }
+
+    const float* colors = (const float*)(file.data + header.colorOffset);
+    const float* vertices = (const float*)(file.data + header.vertexOffset);
+    if (!upload)
+    {
+        batch.assign(shapes, header.shapeCount, colors, header.colorCount, vertices, header.vertexCount);
+        return true;
+    }
+    batch.assign(shapes, header.shapeCount, colors, header.colorCount);
+    batch.upload(vertices, header.vertexCount);
+    return true;
+}
+
+// Whether path holds a scene in the binary form, going by its magic
+inline bool isBinaryScene(const char* path)
+{
+    char magic[4] = {};
+    FILE* file = std::fopen(path, "rb");
+    if (!file)
+        return false;
+    size_t read = std::fread(magic, 1, 4, file);
+    std::fclose(file);
+    return read == 4 && std::memcmp(magic, "SCNB", 4) == 0;
+}
+
+// Load either form, telling them apart by the binary magic, and upload it unless told not to.
+// Binary scenes were tessellated when they were written, so tessellation only applies to text.
+inline bool loadScene(const char* path, SceneBatch& batch, bool upload = true,
+    const TessellationSettings& tessellation = TessellationSettings())
+{
+    if (isBinaryScene(path))
+        return loadSceneBinary(path, batch, upload);
+
+    if (!parseSceneText(path, batch, tessellation))
+        return false;
+    if (upload)
+        batch.upload();
+    return true;
+}
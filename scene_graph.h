@@ -0,0 +1,165 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "gl_objects.h"
+#include "transform2d.h"
+
+// Parent/child hierarchy of 2D transforms.
+//
+// Nodes live in flat arrays and a parent is always added before its children, so one
+// front-to-back pass computes every world transform: a node is recomputed only if its
+// own transform or its parent's world transform changed.
+//
+// World transforms are kept as two rows of the 2D affine matrix, (a c tx 0) and
+// (b d ty 0), which is also their GPU layout: all of them go out in one buffer write
+// per frame to a texture buffer, and the vertex shader fetches its node's two texels:
+//
+//     uniform samplerBuffer worldMatrices;
+//     uniform int node;
+//     vec4 row0 = texelFetch(worldMatrices, node * 2);
+//     vec4 row1 = texelFetch(worldMatrices, node * 2 + 1);
+//
+// A texture buffer holds far more nodes than a uniform block and only needs GL 3.1.
+class SceneGraph
+{
+public:
+    // Add a node under parent (-1 for a root) and return its index
+    int addNode(int parent)
+    {
+        int node = (int)parents_.size();
+        parents_.push_back(parent < node ? parent : -1);
+        locals_.push_back(Transform2D());
+        computedVersions_.push_back(0);
+        changed_.push_back(1);
+        worldRows_.insert(worldRows_.end(), floatsPerNode, 0.0f);
+        return node;
+    }
+
+    Transform2D& local(int node) { return locals_[node]; }
+    int parent(int node) const { return parents_[node]; }
+    int nodeCount() const { return (int)parents_.size(); }
+
+    // World transform of a node as of the last update()
+    glm::mat4 world(int node) const
+    {
+        const float* rows = &worldRows_[node * floatsPerNode];
+        glm::mat4 matrix(1.0f);
+        matrix[0][0] = rows[0];
+        matrix[1][0] = rows[1];
+        matrix[3][0] = rows[2];
+        matrix[0][1] = rows[4];
+        matrix[1][1] = rows[5];
+        matrix[3][1] = rows[6];
+        return matrix;
+    }
+
+    // Propagate world transforms top-down in one linear pass; returns whether any of
+    // them changed
+    bool update()
+    {
+        bool anyChanged = false;
+        for (int node = 0; node < (int)parents_.size(); node++)
+        {
+            const Transform2D& local = locals_[node];
+            int parent = parents_[node];
+            bool parentChanged = parent >= 0 && changed_[parent];
+            changed_[node] = parentChanged || computedVersions_[node] != local.version();
+            if (!changed_[node])
+                continue;
+
+            const glm::mat4& l = local.matrix();
+            float* w = &worldRows_[node * floatsPerNode];
+            if (parent < 0)
+            {
+                w[0] = l[0][0]; w[1] = l[1][0]; w[2] = l[3][0];
+                w[4] = l[0][1]; w[5] = l[1][1]; w[6] = l[3][1];
+            }
+            else
+            {
+                const float* p = &worldRows_[parent * floatsPerNode];
+                w[0] = p[0] * l[0][0] + p[1] * l[0][1];
+                w[1] = p[0] * l[1][0] + p[1] * l[1][1];
+                w[2] = p[0] * l[3][0] + p[1] * l[3][1] + p[2];
+                w[4] = p[4] * l[0][0] + p[5] * l[0][1];
+                w[5] = p[4] * l[1][0] + p[5] * l[1][1];
+                w[6] = p[4] * l[3][0] + p[5] * l[3][1] + p[6];
+            }
+            computedVersions_[node] = local.version();
+            uploadNeeded_ = true;
+            anyChanged = true;
+        }
+        return anyChanged;
+    }
+
+    // World transforms of every node in their GPU layout, as of the last update()
+    const std::vector<float>& worldRows() const { return worldRows_; }
+
+    // Write every world transform to the GPU in one call, if any of them changed
+    void upload()
+    {
+        if (uploadNeeded_ || texture == 0)
+            upload(worldRows_);
+        uploadNeeded_ = false;
+    }
+
+    // Write world transforms computed elsewhere, e.g. a copy of worldRows() taken on
+    // another thread, to the GPU
+    void upload(const std::vector<float>& rows)
+    {
+        if (texture == 0)
+            glGenTextures(1, &texture);
+
+        // a new size may come with a different buffer from the pool, so the texture is
+        // pointed at it again
+        size_t bytes = rows.size() * sizeof(float);
+        if (bytes != uploadedBytes_)
+        {
+            TBO.data(GL_TEXTURE_BUFFER, bytes, rows.data(), GL_DYNAMIC_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, TBO);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            uploadedBytes_ = bytes;
+        }
+        else
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, TBO);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, rows.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Bind the world transforms for the worldMatrices sampler on the given texture unit
+    void bind(int textureUnit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(1, &texture);
+        TBO.reset();
+        texture = 0;
+        uploadedBytes_ = 0;
+        uploadNeeded_ = true;
+    }
+
+    GLBuffer TBO;
+    unsigned int texture = 0;
+
+    static const int floatsPerNode = 8;
+
+private:
+    std::vector<int> parents_;
+    std::vector<Transform2D> locals_;
+    std::vector<unsigned int> computedVersions_;
+    std::vector<char> changed_;
+    std::vector<float> worldRows_;
+    size_t uploadedBytes_ = 0;
+    bool uploadNeeded_ = true;
+};
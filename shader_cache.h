@@ -0,0 +1,288 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "gl_objects.h"
+
+// program binaries are core in GL 4.1 (ARB_get_program_binary); a 3.3 glad does not
+// declare them, so they are looked up at runtime
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP GetProgramBinaryFunc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryFunc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriFunc)(GLuint program, GLenum pname, GLint value);
+
+// 64-bit FNV-1a hash of a shader source string
+inline uint64_t hashShaderSource(const char* source)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0, n = std::strlen(source); i < n; i++)
+    {
+        hash ^= (unsigned char)source[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Compiles every unique shader source once and links every unique vertex/fragment
+// pair once. Programs that ask for the same sources get the same GL program back.
+//
+// With enableBinaryCache() linked programs are also saved as driver binaries in a
+// local directory, keyed by the source hashes and the GL vendor/renderer/version, so
+// later runs skip compiling and linking entirely. A binary the driver rejects (after
+// a driver update, say) is recompiled and overwritten.
+class ShaderCache
+{
+public:
+    // Store program binaries under directory. Returns false, leaving the cache
+    // memory-only, when the context offers no binary formats.
+    bool enableBinaryCache(const char* directory)
+    {
+        // a non-NULL glfwGetProcAddress result does not mean the context has the entry
+        // point, and on a context without binaries GL_NUM_PROGRAM_BINARY_FORMATS is an
+        // invalid enum whose error would be left for unrelated code to find, so the
+        // version or extension decides first
+        if (!programBinarySupported())
+            return false;
+        getProgramBinary_ = (GetProgramBinaryFunc)glfwGetProcAddress("glGetProgramBinary");
+        programBinary_ = (ProgramBinaryFunc)glfwGetProcAddress("glProgramBinary");
+        programParameteri_ = (ProgramParameteriFunc)glfwGetProcAddress("glProgramParameteri");
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (!getProgramBinary_ || !programBinary_ || !programParameteri_ || formatCount == 0)
+            return false;
+
+#ifdef _WIN32
+        _mkdir(directory);
+#else
+        mkdir(directory, 0755);
+#endif
+        binaryDirectory_ = directory;
+
+        // binaries are only valid for the driver that produced them
+        std::string driver;
+        driver += (const char*)glGetString(GL_VENDOR);
+        driver += (const char*)glGetString(GL_RENDERER);
+        driver += (const char*)glGetString(GL_VERSION);
+        driverHash_ = hashShaderSource(driver.c_str());
+        return true;
+    }
+
+    // Return a linked program for the two sources, or 0 if compiling or linking failed
+    unsigned int getProgram(const char* vertexSource, const char* fragmentSource)
+    {
+        uint64_t vertexHash = hashShaderSource(vertexSource);
+        uint64_t fragmentHash = hashShaderSource(fragmentSource);
+        uint64_t programKey = vertexHash * 31 + fragmentHash;
+
+        auto found = programs_.find(programKey);
+        if (found != programs_.end())
+            return found->second;
+
+        std::string binaryPath;
+        if (!binaryDirectory_.empty())
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)(programKey * 31 + driverHash_));
+            binaryPath = binaryDirectory_ + name;
+
+            GLProgram program;
+            if (loadBinary(binaryPath, vertexHash, fragmentHash, program))
+            {
+                binaryLoads_++;
+                return programs_[programKey] = std::move(program);
+            }
+        }
+
+        unsigned int vertexShader = getShader(GL_VERTEX_SHADER, vertexSource, vertexHash);
+        unsigned int fragmentShader = getShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentHash);
+        if (vertexShader == 0 || fragmentShader == 0)
+            return 0;
+
+        GLProgram program;
+        program.create();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        if (!binaryPath.empty())
+            programParameteri_(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        glDetachShader(program, vertexShader);
+        glDetachShader(program, fragmentShader);
+
+        int success;
+        char infoLog[512];
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(program, 512, NULL, infoLog);
+            std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
+            return 0;
+        }
+
+        programLinks_++;
+        if (!binaryPath.empty())
+            saveBinary(binaryPath, vertexHash, fragmentHash, program);
+
+        return programs_[programKey] = std::move(program);
+    }
+
+    // Delete every shader and program the cache created
+    void destroy()
+    {
+        for (auto& entry : shaders_)
+            glDeleteShader(entry.second);
+        programs_.clear();
+        shaders_.clear();
+    }
+
+    // GL 4.1 or ARB_get_program_binary, as the current context reports it
+    static bool programBinarySupported()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 1) || glfwExtensionSupported("GL_ARB_get_program_binary");
+    }
+
+    int programCount() const { return (int)programs_.size(); }
+    int shaderCount() const { return (int)shaders_.size(); }
+    int binaryLoads() const { return binaryLoads_; }
+    int programLinks() const { return programLinks_; }
+
+private:
+    // binary file layout: the vertex, fragment and driver hashes the file was made for
+    // (so a file whose name collides with another program's is not taken for it),
+    // GLenum format, GLsizei length, then the driver's binary blob
+    struct BinaryHeader
+    {
+        uint64_t vertexHash;
+        uint64_t fragmentHash;
+        uint64_t driverHash;
+        GLenum format;
+        GLsizei length;
+    };
+
+    bool loadBinary(const std::string& path, uint64_t vertexHash, uint64_t fragmentHash, GLProgram& program)
+    {
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        BinaryHeader header = {};
+        std::vector<char> binary;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+            && header.vertexHash == vertexHash && header.fragmentHash == fragmentHash
+            && header.driverHash == driverHash_ && header.length > 0;
+        if (ok)
+        {
+            binary.resize(header.length);
+            ok = std::fread(binary.data(), 1, header.length, file) == (size_t)header.length;
+        }
+        std::fclose(file);
+        if (!ok)
+            return false;
+
+        program.create();
+        programBinary_(program, header.format, binary.data(), header.length);
+
+        int success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // stale or foreign binary: fall back to compiling, which rewrites the file
+            program.reset();
+            return false;
+        }
+        return true;
+    }
+
+    // Written to a file of this process's own and renamed into place, so concurrent runs
+    // never read a half-written binary; a failed write leaves nothing behind
+    void saveBinary(const std::string& path, uint64_t vertexHash, uint64_t fragmentHash, unsigned int program)
+    {
+        BinaryHeader header = { vertexHash, fragmentHash, driverHash_, 0, 0 };
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+        if (header.length <= 0)
+            return;
+        std::vector<char> binary(header.length);
+        getProgramBinary_(program, header.length, &header.length, &header.format, binary.data());
+
+#ifdef _WIN32
+        std::string temporary = path + "." + std::to_string(_getpid()) + ".tmp";
+#else
+        std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+        FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+            return;
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+            && std::fwrite(binary.data(), 1, header.length, file) == (size_t)header.length;
+        ok = std::fclose(file) == 0 && ok;
+
+        // rename does not replace an existing file on Windows; one there was written by
+        // another run for the same key, so this copy is not needed
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+            std::remove(temporary.c_str());
+    }
+
+    unsigned int getShader(GLenum type, const char* source, uint64_t sourceHash)
+    {
+        uint64_t key = sourceHash ^ type;
+        auto found = shaders_.find(key);
+        if (found != shaders_.end())
+            return found->second;
+
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+
+        int success;
+        char infoLog[512];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cerr << (type == GL_VERTEX_SHADER ? "Vertex" : "Fragment") << " shader compilation failed:\n" << infoLog << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        shaders_[key] = shader;
+        return shader;
+    }
+
+    std::unordered_map<uint64_t, unsigned int> shaders_;
+    std::unordered_map<uint64_t, GLProgram> programs_;
+
+    std::string binaryDirectory_;
+    uint64_t driverHash_ = 0;
+    GetProgramBinaryFunc getProgramBinary_ = NULL;
+    ProgramBinaryFunc programBinary_ = NULL;
+    ProgramParameteriFunc programParameteri_ = NULL;
+    int binaryLoads_ = 0;
+    int programLinks_ = 0;
+};
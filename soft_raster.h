@@ -0,0 +1,736 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Kernel selection happens at compile time: AVX2 when the compiler targets it (/arch:AVX2,
+// -mavx2), SSE2 on any x86-64 build, scalar otherwise or when SOFT_RASTER_SCALAR is defined
+#if !defined(SOFT_RASTER_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define SOFT_RASTER_AVX2 1
+#elif !defined(SOFT_RASTER_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SOFT_RASTER_SSE2 1
+#endif
+
+#include "scene_batch.h"
+#include "thread_pool.h"
+
+// CPU rasterizer for the flat-colored 2D scenes, for machines without a GPU.
+//
+// It takes the same input as the GL path (x, y, z vertices in normalized device
+// coordinates, GL primitive modes, RGBA colors) and follows GL's rules closely enough
+// that its frames match the driver's to within a few edge pixels:
+//
+//   - triangles are filled by pixel centers using half-space edge functions on 4-bit
+//     subpixel fixed point, with a top-left style tie rule so shared edges are drawn
+//     exactly once
+//   - the screen is walked in 8x8 pixel blocks; blocks fully outside an edge are
+//     skipped, blocks fully inside all edges are filled outright, and the rest evaluate
+//     one 8-pixel row per step with AVX2 (8 lanes), SSE2 (2 x 4 lanes) or scalar code
+//   - lines are one pixel wide and, like GL's diamond-exit rule, leave out their last
+//     pixel; GL_LINE polygon mode draws the edges of every triangle this way
+//
+// Draws and clears are only recorded; flush() renders them. It sets up and bins the
+// primitives into 64x64 pixel tiles in parallel (each thread bins its own chunk of the
+// frame's primitives), then rasterizes the tiles in parallel on a work-stealing pool.
+// A tile belongs to one thread at a time and walks its bins in submission order, so
+// the framebuffer needs no locks and the result does not depend on the thread count.
+//
+// readPixels() returns rows bottom-up like GL's, so its output goes to writePPM as is.
+class SoftwareRasterizer
+{
+public:
+    static const int subpixelBits = 4;
+    static const int blockSize = 8;
+    static const int tileSize = 64;
+    static const int primitivesPerChunk = 4096;
+
+    void resize(int targetWidth, int targetHeight)
+    {
+        width = targetWidth;
+        height = targetHeight;
+
+        // the buffer is padded to whole blocks so block writes never need clipping
+        blocksPerRow_ = (width + blockSize - 1) / blockSize;
+        int blockRows = (height + blockSize - 1) / blockSize;
+        pixels_.assign((size_t)blocksPerRow_ * blockRows * blockSize * blockSize, 0);
+
+        tilesPerRow_ = (width + tileSize - 1) / tileSize;
+        tileRows_ = (height + tileSize - 1) / tileSize;
+        primitives_.clear();
+        clearPending_ = false;
+    }
+
+    // Rasterize with this many threads (the calling thread included)
+    void setThreadCount(int threadCount)
+    {
+        if (!pool_ || pool_->threadCount() != threadCount)
+            pool_.reset(new ThreadPool(threadCount));
+    }
+
+    int threadCount() const { return pool_ ? pool_->threadCount() : 1; }
+
+    void clear(const float* rgba)
+    {
+        // a clear is applied per tile at the start of the next flush
+        flush();
+        clearColor_ = packColor(rgba);
+        clearPending_ = true;
+    }
+
+    // GL_FILL or GL_LINE, as glPolygonMode
+    void setPolygonMode(GLenum mode) { polygonMode_ = mode; }
+
+    // Draw vertices [first, first + count) of an x, y, z array in the given mode and color
+    void drawArrays(GLenum mode, const float* vertices, int first, int count, const float* rgba)
+    {
+        uint32_t color = packColor(rgba);
+        const float* v = vertices + first * 3;
+
+        switch (mode)
+        {
+        case GL_TRIANGLES:
+            for (int i = 0; i + 2 < count; i += 3)
+                drawTriangle(v + i * 3, v + (i + 1) * 3, v + (i + 2) * 3, color);
+            break;
+        case GL_TRIANGLE_STRIP:
+            // odd triangles swap their first two vertices to keep the strip's winding
+            for (int i = 0; i + 2 < count; i++)
+            {
+                if (i % 2 == 0)
+                    drawTriangle(v + i * 3, v + (i + 1) * 3, v + (i + 2) * 3, color);
+                else
+                    drawTriangle(v + (i + 1) * 3, v + i * 3, v + (i + 2) * 3, color);
+            }
+            break;
+        case GL_TRIANGLE_FAN:
+            for (int i = 1; i + 1 < count; i++)
+                drawTriangle(v, v + i * 3, v + (i + 1) * 3, color);
+            break;
+        case GL_LINES:
+            for (int i = 0; i + 1 < count; i += 2)
+                drawLine(v + i * 3, v + (i + 1) * 3, color);
+            break;
+        case GL_LINE_STRIP:
+        case GL_LINE_LOOP:
+            for (int i = 0; i + 1 < count; i++)
+                drawLine(v + i * 3, v + (i + 1) * 3, color);
+            if (mode == GL_LINE_LOOP && count > 2)
+                drawLine(v + (count - 1) * 3, v, color);
+            break;
+        case GL_POINTS:
+            for (int i = 0; i < count; i++)
+                drawPoint(v + i * 3, color);
+            break;
+        }
+    }
+
+    // Draw every shape of a batch in order, as SceneBatch::draw does on the GPU
+    void drawBatch(const SceneBatch& batch)
+    {
+        const std::vector<float>& vertices = batch.vertices();
+        const std::vector<float>& colors = batch.colors();
+        for (const BatchShape& shape : batch.shapes())
+            drawArrays(shape.mode, vertices.data(), shape.first, shape.count, &colors[shape.color * 4]);
+    }
+
+    // Render everything recorded since the last flush
+    void flush()
+    {
+        if (primitives_.empty() && !clearPending_)
+            return;
+        if (!pool_)
+            setThreadCount(1);
+
+        // Set up and bin: chunk c of the primitives goes into bins_[c * tileCount + tile]
+        int tileCount = tilesPerRow_ * tileRows_;
+        int chunkCount = ((int)primitives_.size() + primitivesPerChunk - 1) / primitivesPerChunk;
+        setups_.resize(primitives_.size());
+        if (bins_.size() < (size_t)chunkCount * tileCount)
+            bins_.resize((size_t)chunkCount * tileCount);
+        pool_->parallelFor(chunkCount, [&](int chunk, int)
+        {
+            binChunk(chunk, &bins_[(size_t)chunk * tileCount]);
+        });
+
+        // Rasterize: each tile walks every chunk's bin for it, in order
+        pool_->parallelFor(tileCount, [&](int tile, int)
+        {
+            TileRect rect;
+            rect.minX = (tile % tilesPerRow_) * tileSize;
+            rect.minY = (tile / tilesPerRow_) * tileSize;
+            rect.maxX = std::min(rect.minX + tileSize, width) - 1;
+            rect.maxY = std::min(rect.minY + tileSize, height) - 1;
+            if (clearPending_)
+                clearTile(rect);
+            for (int chunk = 0; chunk < chunkCount; chunk++)
+            {
+                std::vector<uint32_t>& bin = bins_[(size_t)chunk * tileCount + tile];
+                for (uint32_t entry : bin)
+                    rasterizePrimitive(entry, rect);
+                bin.clear();
+            }
+        });
+
+        primitives_.clear();
+        clearPending_ = false;
+    }
+
+    // Tightly packed RGBA rows, bottom row first, as glReadPixels returns them
+    void readPixels(std::vector<unsigned char>& rgba)
+    {
+        flush();
+        rgba.resize((size_t)width * height * 4);
+        for (int y = 0; y < height; y++)
+        {
+            unsigned char* out = &rgba[(size_t)y * width * 4];
+            for (int x = 0; x < width; x++)
+            {
+                uint32_t pixel = *pixelAt(x, y);
+                out[x * 4 + 0] = (unsigned char)(pixel & 0xff);
+                out[x * 4 + 1] = (unsigned char)((pixel >> 8) & 0xff);
+                out[x * 4 + 2] = (unsigned char)((pixel >> 16) & 0xff);
+                out[x * 4 + 3] = (unsigned char)(pixel >> 24);
+            }
+        }
+    }
+
+    // Primitives drawn since construction (triangles filled or outlined, lines)
+    long long triangleCount() const { return triangleCount_; }
+    long long lineCount() const { return lineCount_; }
+
+    int width = 0;
+    int height = 0;
+
+private:
+    // Vertices further out than this (in NDC) are clipped away before setup, which keeps
+    // every fixed-point edge term well inside 64-bit setup and 32-bit block arithmetic
+    static constexpr float guardBand = 8.0f;
+
+    enum PrimitiveType { TrianglePrimitive, LinePrimitive, PointPrimitive };
+    static const int typeShift = 30;
+
+    // A recorded primitive in window coordinates
+    struct Primitive
+    {
+        float x[3];
+        float y[3];
+        uint32_t color;
+        int type;
+    };
+
+    // E(x, y) = a * x + b * y + c over subpixel coordinates; a and b, the change of E per
+    // subpixel, stay below 2^19 inside the guard band
+    struct Edge
+    {
+        int32_t a, b;
+        int64_t c;
+    };
+
+    // Pixel bounds (inclusive) of a primitive or a tile
+    struct TileRect
+    {
+        int minX, minY, maxX, maxY;
+    };
+
+    // What rasterizing a triangle needs, computed once and shared by all its tiles. Tiles
+    // read setups in bin order, so they are kept to one cache line each.
+    struct TriangleSetup
+    {
+        Edge edges[3];
+        int16_t minX, minY, maxX, maxY;     // pixel bounds on screen
+        uint32_t color;
+    };
+
+    // Pixels are stored block by block, each 8x8 block as 64 consecutive pixels (rows
+    // bottom-up), so rasterizing a block touches four cache lines instead of eight rows
+    // spread over the whole frame
+    uint32_t* pixelAt(int x, int y)
+    {
+        size_t block = (size_t)(y / blockSize) * blocksPerRow_ + x / blockSize;
+        return &pixels_[block * blockSize * blockSize + (y % blockSize) * blockSize + x % blockSize];
+    }
+
+    const uint32_t* pixelAt(int x, int y) const
+    {
+        return const_cast<SoftwareRasterizer*>(this)->pixelAt(x, y);
+    }
+
+    static uint32_t packColor(const float* rgba)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            float c = std::min(std::max(rgba[i], 0.0f), 1.0f);
+            packed |= (uint32_t)(c * 255.0f + 0.5f) << (i * 8);
+        }
+        return packed;
+    }
+
+    // NDC to window coordinates, y up
+    void toWindow(const float* ndc, float* window) const
+    {
+        window[0] = (ndc[0] + 1.0f) * 0.5f * width;
+        window[1] = (ndc[1] + 1.0f) * 0.5f * height;
+    }
+
+    static bool insideGuardBand(const float* v)
+    {
+        return std::fabs(v[0]) <= guardBand && std::fabs(v[1]) <= guardBand;
+    }
+
+    void drawTriangle(const float* a, const float* b, const float* c, uint32_t color)
+    {
+        triangleCount_++;
+        if (polygonMode_ == GL_LINE)
+        {
+            drawLine(a, b, color);
+            drawLine(b, c, color);
+            drawLine(c, a, color);
+            return;
+        }
+
+        if (insideGuardBand(a) && insideGuardBand(b) && insideGuardBand(c))
+        {
+            float w[3][2];
+            toWindow(a, w[0]);
+            toWindow(b, w[1]);
+            toWindow(c, w[2]);
+            recordTriangle(w[0], w[1], w[2], color);
+            return;
+        }
+
+        // Clip against the guard band and fan out the remaining polygon
+        float polygon[9][2], clipped[9][2];
+        const float* input[3] = { a, b, c };
+        for (int i = 0; i < 3; i++)
+        {
+            polygon[i][0] = input[i][0];
+            polygon[i][1] = input[i][1];
+        }
+        int count = 3;
+        for (int plane = 0; plane < 4 && count > 0; plane++)
+        {
+            int axis = plane / 2;
+            float sign = plane % 2 == 0 ? 1.0f : -1.0f;
+            int out = 0;
+            for (int i = 0; i < count; i++)
+            {
+                const float* p = polygon[i];
+                const float* q = polygon[(i + 1) % count];
+                float dp = guardBand - sign * p[axis];
+                float dq = guardBand - sign * q[axis];
+                if (dp >= 0.0f)
+                {
+                    clipped[out][0] = p[0];
+                    clipped[out][1] = p[1];
+                    out++;
+                }
+                if ((dp >= 0.0f) != (dq >= 0.0f))
+                {
+                    float t = dp / (dp - dq);
+                    clipped[out][0] = p[0] + (q[0] - p[0]) * t;
+                    clipped[out][1] = p[1] + (q[1] - p[1]) * t;
+                    out++;
+                }
+            }
+            count = out;
+            std::copy(&clipped[0][0], &clipped[0][0] + count * 2, &polygon[0][0]);
+        }
+
+        float w[9][2];
+        for (int i = 0; i < count; i++)
+            toWindow(polygon[i], w[i]);
+        for (int i = 1; i + 1 < count; i++)
+            recordTriangle(w[0], w[i], w[i + 1], color);
+    }
+
+    void recordTriangle(const float* w0, const float* w1, const float* w2, uint32_t color)
+    {
+        Primitive primitive;
+        primitive.x[0] = w0[0]; primitive.y[0] = w0[1];
+        primitive.x[1] = w1[0]; primitive.y[1] = w1[1];
+        primitive.x[2] = w2[0]; primitive.y[2] = w2[1];
+        primitive.color = color;
+        primitive.type = TrianglePrimitive;
+        primitives_.push_back(primitive);
+    }
+
+    static Edge setupEdge(int64_t x0, int64_t y0, int64_t x1, int64_t y1)
+    {
+        // inside is on the left of a counter-clockwise edge; pixel centers exactly on a
+        // left or top edge are in, on any other edge they are out
+        Edge edge;
+        edge.a = (int32_t)(y0 - y1);
+        edge.b = (int32_t)(x1 - x0);
+        edge.c = x0 * y1 - y0 * x1;
+        bool topLeft = y1 < y0 || (y1 == y0 && x1 < x0);
+        if (!topLeft)
+            edge.c -= 1;
+        return edge;
+    }
+
+    // Fixed-point setup of a triangle and its pixel bounds on screen; false when it
+    // covers no pixel centers
+    bool setupTriangle(const Primitive& primitive, TriangleSetup& setup) const
+    {
+        const float scale = (float)(1 << subpixelBits);
+        int64_t x0 = (int64_t)std::floor(primitive.x[0] * scale + 0.5f), y0 = (int64_t)std::floor(primitive.y[0] * scale + 0.5f);
+        int64_t x1 = (int64_t)std::floor(primitive.x[1] * scale + 0.5f), y1 = (int64_t)std::floor(primitive.y[1] * scale + 0.5f);
+        int64_t x2 = (int64_t)std::floor(primitive.x[2] * scale + 0.5f), y2 = (int64_t)std::floor(primitive.y[2] * scale + 0.5f);
+
+        int64_t area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0)
+            return false;
+        if (area < 0)
+        {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+        }
+
+        // pixels whose centers (i + 0.5) can fall inside the triangle, clamped to the screen
+        const int64_t half = 1 << (subpixelBits - 1);
+        TileRect bounds;
+        int64_t minX = std::min(x0, std::min(x1, x2)), maxX = std::max(x0, std::max(x1, x2));
+        int64_t minY = std::min(y0, std::min(y1, y2)), maxY = std::max(y0, std::max(y1, y2));
+        bounds.minX = (int)std::max<int64_t>(0, (minX - half + (1 << subpixelBits) - 1) >> subpixelBits);
+        bounds.minY = (int)std::max<int64_t>(0, (minY - half + (1 << subpixelBits) - 1) >> subpixelBits);
+        bounds.maxX = (int)std::min<int64_t>(width - 1, (maxX - half) >> subpixelBits);
+        bounds.maxY = (int)std::min<int64_t>(height - 1, (maxY - half) >> subpixelBits);
+        if (bounds.minX > bounds.maxX || bounds.minY > bounds.maxY)
+            return false;
+
+        setup.edges[0] = setupEdge(x0, y0, x1, y1);
+        setup.edges[1] = setupEdge(x1, y1, x2, y2);
+        setup.edges[2] = setupEdge(x2, y2, x0, y0);
+        setup.minX = (int16_t)bounds.minX;
+        setup.minY = (int16_t)bounds.minY;
+        setup.maxX = (int16_t)bounds.maxX;
+        setup.maxY = (int16_t)bounds.maxY;
+        setup.color = primitive.color;
+        return true;
+    }
+
+    // Fill the triangle's pixels inside tile (whose edges lie on block boundaries)
+    void rasterizeTriangle(const TriangleSetup& setup, const TileRect& tile)
+    {
+        const int64_t half = 1 << (subpixelBits - 1);
+        const Edge* edges = setup.edges;
+        TileRect rect;
+        rect.minX = std::max(tile.minX, (int)setup.minX);
+        rect.minY = std::max(tile.minY, (int)setup.minY);
+        rect.maxX = std::min(tile.maxX, (int)setup.maxX);
+        rect.maxY = std::min(tile.maxY, (int)setup.maxY);
+
+        // per-pixel steps, and how far E can rise or fall across one block from its
+        // first pixel center
+        int32_t stepX[3], stepY[3];
+        int64_t blockMax[3], blockMin[3];
+        for (int e = 0; e < 3; e++)
+        {
+            stepX[e] = edges[e].a * (1 << subpixelBits);   // multiplied, not shifted: a and b may be negative
+            stepY[e] = edges[e].b * (1 << subpixelBits);
+            int64_t dx = (int64_t)stepX[e] * (blockSize - 1);
+            int64_t dy = (int64_t)stepY[e] * (blockSize - 1);
+            blockMax[e] = std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0);
+            blockMin[e] = std::min<int64_t>(dx, 0) + std::min<int64_t>(dy, 0);
+        }
+
+        int blockMinX = rect.minX & ~(blockSize - 1);
+        int blockMinY = rect.minY & ~(blockSize - 1);
+        for (int by = blockMinY; by <= rect.maxY; by += blockSize)
+        {
+            int64_t centerY = ((int64_t)by << subpixelBits) + half;
+            int64_t centerX = ((int64_t)blockMinX << subpixelBits) + half;
+            int64_t value[3];
+            for (int e = 0; e < 3; e++)
+                value[e] = edges[e].a * centerX + edges[e].b * centerY + edges[e].c;
+
+            for (int bx = blockMinX; bx <= rect.maxX; bx += blockSize)
+            {
+                bool outside = false, covered = true;
+                for (int e = 0; e < 3; e++)
+                {
+                    outside = outside || value[e] + blockMax[e] < 0;
+                    covered = covered && value[e] + blockMin[e] >= 0;
+                }
+
+                if (!outside)
+                {
+                    uint32_t* block = pixelAt(bx, by);
+                    if (covered)
+                        fillBlock(block, setup.color);
+                    else
+                    {
+                        // an edge that is undecided over the block stays within a few
+                        // million of zero; one that passes the whole block can be capped
+                        // without turning negative, so every value fits 32 bits
+                        int32_t start[3];
+                        for (int e = 0; e < 3; e++)
+                            start[e] = (int32_t)std::min<int64_t>(value[e], 1 << 30);
+                        rasterizeBlock(block, start, stepX, stepY, setup.color);
+                    }
+                }
+
+                for (int e = 0; e < 3; e++)
+                    value[e] += (int64_t)stepX[e] * blockSize;
+            }
+        }
+    }
+
+    void fillBlock(uint32_t* block, uint32_t color)
+    {
+        std::fill(block, block + blockSize * blockSize, color);
+    }
+
+    // Test the 8x8 pixel centers of a block against the three edges, one row at a time
+    void rasterizeBlock(uint32_t* block, const int32_t* start, const int32_t* stepX, const int32_t* stepY, uint32_t color)
+    {
+#if defined(SOFT_RASTER_AVX2)
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(start[0]), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stepX[0])));
+        __m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(start[1]), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stepX[1])));
+        __m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(start[2]), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stepX[2])));
+        const __m256i step0 = _mm256_set1_epi32(stepY[0]);
+        const __m256i step1 = _mm256_set1_epi32(stepY[1]);
+        const __m256i step2 = _mm256_set1_epi32(stepY[2]);
+        const __m256i fill = _mm256_set1_epi32((int)color);
+        for (int row = 0; row < blockSize; row++)
+        {
+            // a negative edge value sets the sign bit: the pixel is outside
+            __m256i outside = _mm256_srai_epi32(_mm256_or_si256(e0, _mm256_or_si256(e1, e2)), 31);
+            __m256i* dst = (__m256i*)(block + row * blockSize);
+            _mm256_storeu_si256(dst, _mm256_blendv_epi8(fill, _mm256_loadu_si256(dst), outside));
+            e0 = _mm256_add_epi32(e0, step0);
+            e1 = _mm256_add_epi32(e1, step1);
+            e2 = _mm256_add_epi32(e2, step2);
+        }
+#elif defined(SOFT_RASTER_SSE2)
+        __m128i e[3][2];
+        __m128i step[3];
+        for (int i = 0; i < 3; i++)
+        {
+            int32_t s = stepX[i];
+            e[i][0] = _mm_add_epi32(_mm_set1_epi32(start[i]), _mm_setr_epi32(0, s, 2 * s, 3 * s));
+            e[i][1] = _mm_add_epi32(e[i][0], _mm_set1_epi32(4 * s));
+            step[i] = _mm_set1_epi32(stepY[i]);
+        }
+        const __m128i fill = _mm_set1_epi32((int)color);
+        for (int row = 0; row < blockSize; row++)
+        {
+            __m128i* dst = (__m128i*)(block + row * blockSize);
+            for (int half = 0; half < 2; half++)
+            {
+                __m128i outside = _mm_srai_epi32(_mm_or_si128(e[0][half], _mm_or_si128(e[1][half], e[2][half])), 31);
+                __m128i old = _mm_loadu_si128(dst + half);
+                _mm_storeu_si128(dst + half, _mm_or_si128(_mm_and_si128(outside, old), _mm_andnot_si128(outside, fill)));
+                for (int i = 0; i < 3; i++)
+                    e[i][half] = _mm_add_epi32(e[i][half], step[i]);
+            }
+        }
+#else
+        int32_t rowStart[3] = { start[0], start[1], start[2] };
+        for (int row = 0; row < blockSize; row++)
+        {
+            uint32_t* dst = block + row * blockSize;
+            int32_t e0 = rowStart[0], e1 = rowStart[1], e2 = rowStart[2];
+            for (int x = 0; x < blockSize; x++)
+            {
+                if ((e0 | e1 | e2) >= 0)
+                    dst[x] = color;
+                e0 += stepX[0];
+                e1 += stepX[1];
+                e2 += stepX[2];
+            }
+            for (int i = 0; i < 3; i++)
+                rowStart[i] += stepY[i];
+        }
+#endif
+    }
+
+    void drawLine(const float* a, const float* b, uint32_t color)
+    {
+        lineCount_++;
+        float p[2], q[2];
+        toWindow(a, p);
+        toWindow(b, q);
+
+        Primitive primitive;
+        primitive.x[0] = p[0]; primitive.y[0] = p[1];
+        primitive.x[1] = q[0]; primitive.y[1] = q[1];
+        primitive.color = color;
+        primitive.type = LinePrimitive;
+        primitives_.push_back(primitive);
+    }
+
+    void drawPoint(const float* v, uint32_t color)
+    {
+        float w[2];
+        toWindow(v, w);
+
+        Primitive primitive;
+        primitive.x[0] = w[0];
+        primitive.y[0] = w[1];
+        primitive.color = color;
+        primitive.type = PointPrimitive;
+        primitives_.push_back(primitive);
+    }
+
+    // Pixel bounds of a line or point on screen; false when it is entirely off screen
+    bool lineBounds(const Primitive& primitive, TileRect& bounds) const
+    {
+        int count = primitive.type == LinePrimitive ? 2 : 1;
+        float minX = primitive.x[0], maxX = primitive.x[0];
+        float minY = primitive.y[0], maxY = primitive.y[0];
+        for (int i = 1; i < count; i++)
+        {
+            minX = std::min(minX, primitive.x[i]);
+            maxX = std::max(maxX, primitive.x[i]);
+            minY = std::min(minY, primitive.y[i]);
+            maxY = std::max(maxY, primitive.y[i]);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height)
+            return false;
+        bounds.minX = (int)std::max(minX, 0.0f);
+        bounds.minY = (int)std::max(minY, 0.0f);
+        bounds.maxX = (int)std::min(maxX, (float)(width - 1));
+        bounds.maxY = (int)std::min(maxY, (float)(height - 1));
+        return true;
+    }
+
+    // One pixel wide line: one pixel per column (x-major) or row (y-major), taken where
+    // the line crosses that column's or row's center; the last pixel is left out. Only
+    // pixels inside rect are written, and each pixel is decided on its own, so a line
+    // split over several tiles comes out the same as drawn whole.
+    void rasterizeLine(const Primitive& primitive, const TileRect& rect)
+    {
+        const float p[2] = { primitive.x[0], primitive.y[0] };
+        const float q[2] = { primitive.x[1], primitive.y[1] };
+        float dx = q[0] - p[0], dy = q[1] - p[1];
+        bool xMajor = std::fabs(dx) >= std::fabs(dy);
+        int major = xMajor ? 0 : 1;
+        int minor = 1 - major;
+        float length = xMajor ? dx : dy;
+        if (length == 0.0f)
+            return;
+
+        int majorMin = xMajor ? rect.minX : rect.minY, majorMax = xMajor ? rect.maxX : rect.maxY;
+        int minorMin = xMajor ? rect.minY : rect.minX, minorMax = xMajor ? rect.maxY : rect.maxX;
+        float slope = (q[minor] - p[minor]) / length;
+        float start = std::min(std::max(p[major] - 0.5f, (float)majorMin - 1.0f), (float)majorMax + 1.0f);
+        float end = std::min(std::max(q[major] - 0.5f, (float)majorMin - 1.0f), (float)majorMax + 1.0f);
+        int first, last;
+        if (length > 0.0f)
+        {
+            first = (int)std::ceil(start);
+            last = (int)std::ceil(end);
+        }
+        else
+        {
+            // walking backwards: centers in (end, start]
+            first = (int)std::floor(end) + 1;
+            last = (int)std::floor(start) + 1;
+        }
+        first = std::max(first, majorMin);
+        last = std::min(last, majorMax + 1);
+
+        for (int i = first; i < last; i++)
+        {
+            float m = p[minor] + ((float)i + 0.5f - p[major]) * slope;
+            if (m < (float)minorMin || m >= (float)(minorMax + 1))
+                continue;
+            int j = (int)m;
+            int x = xMajor ? i : j, y = xMajor ? j : i;
+            *pixelAt(x, y) = primitive.color;
+        }
+    }
+
+    // Set up chunk's primitives and append each one's index to the bins of the tiles
+    // its bounds overlap
+    void binChunk(int chunk, std::vector<uint32_t>* bins)
+    {
+        int first = chunk * primitivesPerChunk;
+        int last = std::min(first + primitivesPerChunk, (int)primitives_.size());
+        for (int i = first; i < last; i++)
+        {
+            const Primitive& primitive = primitives_[i];
+            TileRect bounds;
+            bool visible;
+            if (primitive.type == TrianglePrimitive)
+            {
+                const TriangleSetup& setup = setups_[i];
+                visible = setupTriangle(primitive, setups_[i]);
+                bounds.minX = setup.minX;
+                bounds.minY = setup.minY;
+                bounds.maxX = setup.maxX;
+                bounds.maxY = setup.maxY;
+            }
+            else
+                visible = lineBounds(primitive, bounds);
+            if (!visible)
+                continue;
+
+            // the type rides in the top bits so tiles need not look at primitives_ for
+            // triangles
+            uint32_t entry = (uint32_t)i | (uint32_t)primitive.type << typeShift;
+
+            for (int ty = bounds.minY / tileSize; ty <= bounds.maxY / tileSize; ty++)
+            {
+                for (int tx = bounds.minX / tileSize; tx <= bounds.maxX / tileSize; tx++)
+                    bins[ty * tilesPerRow_ + tx].push_back(entry);
+            }
+        }
+    }
+
+    void rasterizePrimitive(uint32_t entry, const TileRect& rect)
+    {
+        uint32_t index = entry & ((1u << typeShift) - 1);
+        int type = (int)(entry >> typeShift);
+        if (type == TrianglePrimitive)
+        {
+            rasterizeTriangle(setups_[index], rect);
+            return;
+        }
+
+        const Primitive& primitive = primitives_[index];
+        if (type == LinePrimitive)
+            rasterizeLine(primitive, rect);
+        else
+        {
+            int x = (int)primitive.x[0], y = (int)primitive.y[0];
+            if (x >= rect.minX && x <= rect.maxX && y >= rect.minY && y <= rect.maxY)
+                *pixelAt(x, y) = primitive.color;
+        }
+    }
+
+    void clearTile(const TileRect& rect)
+    {
+        for (int by = rect.minY; by <= rect.maxY; by += blockSize)
+        {
+            for (int bx = rect.minX; bx <= rect.maxX; bx += blockSize)
+                fillBlock(pixelAt(bx, by), clearColor_);
+        }
+    }
+
+    std::vector<uint32_t> pixels_;
+    int blocksPerRow_ = 0;
+    int tilesPerRow_ = 0;
+    int tileRows_ = 0;
+
+    // the frame recorded so far, and what flush() builds from it
+    std::vector<Primitive> primitives_;
+    std::vector<TriangleSetup> setups_;
+    std::vector<std::vector<uint32_t>> bins_;
+    uint32_t clearColor_ = 0;
+    bool clearPending_ = false;
+    std::unique_ptr<ThreadPool> pool_;
+    GLenum polygonMode_ = GL_FILL;
+    long long triangleCount_ = 0;
+    long long lineCount_ = 0;
+};
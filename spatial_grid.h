@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Loose uniform grid of axis-aligned boxes for viewport culling.
+//
+// Every item sits in exactly one cell, the one holding the center of its box (items
+// outside the grid's bounds go to the nearest edge cell). Because a box can stick out of
+// its cell, queries widen the view by the largest half extent of any item before picking
+// the cells to visit. Cells entirely inside the view are taken whole; items of cells on
+// its border are tested box by box. A view that holds every box there is returns every
+// item without looking at the cells.
+//
+// Moving an item is O(1): its box is replaced and, only when its center crossed into
+// another cell, it is swapped out of the old cell's list and appended to the new one.
+// Boxes are (minX, minY, maxX, maxY).
+class SpatialGrid
+{
+public:
+    // Cover bounds with columns x rows cells and drop every item
+    void reset(const float* bounds, int columns, int rows)
+    {
+        minX_ = bounds[0];
+        minY_ = bounds[1];
+        columns_ = std::max(1, columns);
+        rows_ = std::max(1, rows);
+        cellWidth_ = std::max(bounds[2] - bounds[0], 1e-6f) / columns_;
+        cellHeight_ = std::max(bounds[3] - bounds[1], 1e-6f) / rows_;
+        cells_.assign((size_t)columns_ * rows_, std::vector<int>());
+        items_.clear();
+        maxHalfWidth_ = 0.0f;
+        maxHalfHeight_ = 0.0f;
+        itemBounds_[0] = itemBounds_[1] = 1e30f;
+        itemBounds_[2] = itemBounds_[3] = -1e30f;
+    }
+
+    // A square-ish cell count for itemCount items spread over bounds, a few dozen per cell
+    static void suggestCells(const float* bounds, int itemCount, int& columns, int& rows)
+    {
+        const float itemsPerCell = 32.0f;
+        float width = std::max(bounds[2] - bounds[0], 1e-6f), height = std::max(bounds[3] - bounds[1], 1e-6f);
+        float cells = std::max(1.0f, itemCount / itemsPerCell);
+        columns = std::max(1, (int)std::ceil(std::sqrt(cells * width / height)));
+        rows = std::max(1, (int)std::ceil(cells / columns));
+    }
+
+    // Add an item and return its id; ids count up from 0
+    int insert(const float* box)
+    {
+        Item item;
+        std::copy(box, box + 4, item.box);
+        item.cell = cellOf(box);
+        item.slot = (int)cells_[item.cell].size();
+        int id = (int)items_.size();
+        cells_[item.cell].push_back(id);
+        items_.push_back(item);
+        grow(box);
+        return id;
+    }
+
+    // Give an item a new box, moving it to another cell if its center left the old one
+    void update(int id, const float* box)
+    {
+        Item& item = items_[id];
+        std::copy(box, box + 4, item.box);
+        grow(box);
+        int cell = cellOf(box);
+        if (cell == item.cell)
+            return;
+
+        std::vector<int>& old = cells_[item.cell];
+        int last = old.back();
+        old[item.slot] = last;
+        items_[last].slot = item.slot;
+        old.pop_back();
+
+        item.cell = cell;
+        item.slot = (int)cells_[cell].size();
+        cells_[cell].push_back(id);
+    }
+
+    // Append the ids of the items whose box overlaps view, in no particular order, and
+    // return how many there were
+    int query(const float* view, std::vector<int>& visible) const
+    {
+        size_t before = visible.size();
+        if (view[0] <= itemBounds_[0] && view[1] <= itemBounds_[1] && view[2] >= itemBounds_[2] && view[3] >= itemBounds_[3])
+        {
+            visible.resize(before + items_.size());
+            for (size_t id = 0; id < items_.size(); id++)
+                visible[before + id] = (int)id;
+            return (int)items_.size();
+        }
+
+        int column0 = columnOf(view[0] - maxHalfWidth_), column1 = columnOf(view[2] + maxHalfWidth_);
+        int row0 = rowOf(view[1] - maxHalfHeight_), row1 = rowOf(view[3] + maxHalfHeight_);
+        for (int row = row0; row <= row1; row++)
+        {
+            float cellMinY = minY_ + row * cellHeight_;
+            bool rowInside = row > 0 && row < rows_ - 1 && cellMinY >= view[1] && cellMinY + cellHeight_ <= view[3];
+            for (int column = column0; column <= column1; column++)
+            {
+                const std::vector<int>& cell = cells_[(size_t)row * columns_ + column];
+                float cellMinX = minX_ + column * cellWidth_;
+
+                // an inner cell inside the view only holds items whose center is in view;
+                // edge cells may hold items clamped in from outside the grid
+                if (rowInside && column > 0 && column < columns_ - 1 && cellMinX >= view[0]
+                    && cellMinX + cellWidth_ <= view[2])
+                {
+                    visible.insert(visible.end(), cell.begin(), cell.end());
+                    continue;
+                }
+                for (int id : cell)
+                {
+                    const float* box = items_[id].box;
+                    if (box[0] <= view[2] && box[2] >= view[0] && box[1] <= view[3] && box[3] >= view[1])
+                        visible.push_back(id);
+                }
+            }
+        }
+        return (int)(visible.size() - before);
+    }
+
+    int itemCount() const { return (int)items_.size(); }
+    const float* box(int id) const { return items_[id].box; }
+
+private:
+    struct Item
+    {
+        float box[4];
+        int cell;
+        int slot;   // position in the cell's list
+    };
+
+    // clamped as floats, so coordinates far outside the grid cannot overflow an int
+    int columnOf(float x) const { return (int)std::min(std::max(std::floor((x - minX_) / cellWidth_), 0.0f), columns_ - 1.0f); }
+    int rowOf(float y) const { return (int)std::min(std::max(std::floor((y - minY_) / cellHeight_), 0.0f), rows_ - 1.0f); }
+
+    int cellOf(const float* box) const
+    {
+        return rowOf((box[1] + box[3]) * 0.5f) * columns_ + columnOf((box[0] + box[2]) * 0.5f);
+    }
+
+    // bounds only grow, so items that moved inward still count where they were
+    void grow(const float* box)
+    {
+        itemBounds_[0] = std::min(itemBounds_[0], box[0]);
+        itemBounds_[1] = std::min(itemBounds_[1], box[1]);
+        itemBounds_[2] = std::max(itemBounds_[2], box[2]);
+        itemBounds_[3] = std::max(itemBounds_[3], box[3]);
+        maxHalfWidth_ = std::max(maxHalfWidth_, (box[2] - box[0]) * 0.5f);
+        maxHalfHeight_ = std::max(maxHalfHeight_, (box[3] - box[1]) * 0.5f);
+    }
+
+    float minX_ = 0.0f, minY_ = 0.0f;
+    float cellWidth_ = 1.0f, cellHeight_ = 1.0f;
+    int columns_ = 1, rows_ = 1;
+    std::vector<std::vector<int>> cells_ = std::vector<std::vector<int>>(1);
+    std::vector<Item> items_;
+    float maxHalfWidth_ = 0.0f, maxHalfHeight_ = 0.0f;
+    float itemBounds_[4] = { 1e30f, 1e30f, -1e30f, -1e30f };   // union of every box so far
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <vector>
+
+// buffer storage is core in GL 4.4 (ARB_buffer_storage); a 3.3 glad does not declare it,
+// so it is looked up at runtime
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP BufferStorageFunc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// Ring buffer for vertex data that changes every frame.
+//
+// The buffer is split into regionCount regions, one per frame in flight. Each frame
+// writes into its own region with allocate() and ends with endFrame(), which fences the
+// region; a region is only written again once its fence says the GPU has finished
+// reading it, so the CPU never overwrites data a draw still needs and the driver never
+// has to copy or reallocate anything.
+//
+// With glBufferStorage the whole buffer is mapped once, persistently and coherently, and
+// allocate() hands out pointers straight into it. On plain GL 3.3 allocate() hands out
+// CPU memory that commit() copies in with glBufferSubData; if the next region is still
+// busy the buffer is orphaned (glBufferData with no data) instead of waiting.
+class StreamBuffer
+{
+public:
+    static const int regionCount = 3;
+
+    bool create(size_t bytesPerFrame)
+    {
+        // errors left by earlier, unrelated calls are not this function's to report
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        regionSize_ = bytesPerFrame;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+        // a non-NULL glfwGetProcAddress result does not mean the context has the entry
+        // point (GLX hands out pointers for any name), so the version or extension decides
+        BufferStorageFunc bufferStorage = NULL;
+        if (bufferStorageSupported())
+            bufferStorage = (BufferStorageFunc)glfwGetProcAddress("glBufferStorage");
+        if (bufferStorage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(GL_ARRAY_BUFFER, regionSize_ * regionCount, NULL, flags);
+            mapped_ = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize_ * regionCount, flags);
+            if (glGetError() != GL_NO_ERROR || !mapped_)
+            {
+                // the storage may already be immutable, so the fallback starts on a new buffer
+                if (mapped_)
+                    glUnmapBuffer(GL_ARRAY_BUFFER);
+                mapped_ = NULL;
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            }
+        }
+        if (!mapped_)
+        {
+            glBufferData(GL_ARRAY_BUFFER, regionSize_ * regionCount, NULL, GL_STREAM_DRAW);
+            staging_.resize(regionSize_);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        for (int i = 0; i < regionCount; i++)
+            fences_[i] = 0;
+        region_ = 0;
+        used_ = 0;
+        return glGetError() == GL_NO_ERROR;
+    }
+
+    // Reserve bytes in this frame's region and return where to write them, with their
+    // byte offset in the buffer (a multiple of alignment) in offset. Returns NULL when
+    // the frame has used up its region.
+    void* allocate(size_t bytes, size_t alignment, size_t& offset)
+    {
+        if (used_ == 0)
+            beginRegion();
+
+        size_t start = region_ * regionSize_;
+        size_t aligned = (start + used_ + alignment - 1) / alignment * alignment;
+        if (aligned + bytes > start + regionSize_)
+            return NULL;
+
+        offset = aligned;
+        used_ = aligned + bytes - start;
+        if (mapped_)
+            return mapped_ + aligned;
+        return &staging_[aligned - start];
+    }
+
+    // Make this frame's writes visible to draws (a no-op when persistently mapped)
+    void commit()
+    {
+        if (mapped_ || used_ == committed_)
+            return;
+        size_t start = region_ * regionSize_;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, start + committed_, used_ - committed_, &staging_[committed_]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        committed_ = used_;
+    }
+
+    // Call after the frame's last draw from the buffer: fence its region and move on
+    void endFrame()
+    {
+        if (used_ == 0)
+            return;
+        commit();
+        fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region_ = (region_ + 1) % regionCount;
+        used_ = 0;
+        committed_ = 0;
+    }
+
+    void destroy()
+    {
+        for (int i = 0; i < regionCount; i++)
+        {
+            if (fences_[i])
+                glDeleteSync(fences_[i]);
+            fences_[i] = 0;
+        }
+        if (mapped_)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            mapped_ = NULL;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    bool persistent() const { return mapped_ != NULL; }
+
+    // GL 4.4 or ARB_buffer_storage, as the current context reports it
+    static bool bufferStorageSupported()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 4) || glfwExtensionSupported("GL_ARB_buffer_storage");
+    }
+
+    // How often a frame had to wait for the GPU, or orphaned the buffer instead
+    int waits() const { return waits_; }
+    int orphans() const { return orphans_; }
+
+    unsigned int buffer = 0;
+
+private:
+    // Make sure the GPU is done with the region about to be written
+    void beginRegion()
+    {
+        GLsync fence = fences_[region_];
+        if (!fence)
+            return;
+
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            if (mapped_)
+            {
+                waits_++;
+                while (status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            else
+            {
+                // fresh storage: no region of it is in use any more
+                orphans_++;
+                glBindBuffer(GL_ARRAY_BUFFER, buffer);
+                glBufferData(GL_ARRAY_BUFFER, regionSize_ * regionCount, NULL, GL_STREAM_DRAW);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                for (int i = 0; i < regionCount; i++)
+                {
+                    if (fences_[i])
+                        glDeleteSync(fences_[i]);
+                    fences_[i] = 0;
+                }
+                return;
+            }
+        }
+        glDeleteSync(fence);
+        fences_[region_] = 0;
+    }
+
+    size_t regionSize_ = 0;
+    unsigned char* mapped_ = NULL;
+    std::vector<unsigned char> staging_;
+    GLsync fences_[regionCount] = {};
+    int region_ = 0;
+    size_t used_ = 0;
+    size_t committed_ = 0;
+    int waits_ = 0;
+    int orphans_ = 0;
+};
@@ -0,0 +1,496 @@
+//
+//  stress_benchmark.cpp
+//  Throughput of the GL path as the scene grows: grids of 1, 10, 100, ... up to 100000
+//  copies of the house (stress_scene.h) are drawn headlessly for a fixed number of
+//  frames each, the way triangle.cpp draws its scene (one batch, a sorted render queue,
+//  a GL state cache). Reports frames/s, draws/frame, triangles/s and peak memory per
+//  size, writes them as JSON, and flags sizes that got slower or bigger than a stored
+//  baseline by more than --tolerance percent (the exit code is then 1).
+//  Each size also times viewport culling: every shape is filed in a spatial grid
+//  (spatial_grid.h) that is then asked for the shapes in a quarter-screen view.
+//  --compact draws the grids from the compact vertex format of vertex_layout.h instead
+//  of float vertices, to measure what the smaller vertices save.
+//
+//  stress_benchmark [--houses N,N,...] [--frames N] [--house PATH] [--json PATH]
+//                   [--baseline PATH] [--save-baseline] [--tolerance PERCENT] [--compact]
+//
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "gl_objects.h"
+#include "offscreen.h"
+#include "render_queue.h"
+#include "scene_batch.h"
+#include "scene_file.h"
+#include "shader_cache.h"
+#include "spatial_grid.h"
+#include "stress_scene.h"
+#include "vertex_layout.h"
+
+// settings
+const unsigned int SCR_WIDTH = 1920;
+const unsigned int SCR_HEIGHT = 1080;
+
+const char* vertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec3 aPos;\n"
+"void main()\n"
+"{\n"
+"   gl_Position = vec4(aPos, 1.0);\n"
+"}\0";
+
+const char* flatColorFragmentShaderSource = "#version 330 core\n"
+"out vec4 FragColor;\n"
+"uniform vec4 color;\n"
+"void main()\n"
+"{\n"
+"   FragColor = color;\n"
+"}\n\0";
+
+// --compact: positions as fractions of their range's box, colors per vertex
+const char* compactVertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec2 aPos;\n"
+"layout (location = 1) in vec4 aColor;\n"
+"uniform vec4 positionBox;\n"
+"out vec4 vertexColor;\n"
+"void main()\n"
+"{\n"
+"   gl_Position = vec4(positionBox.xy + aPos * positionBox.zw, 0.0, 1.0);\n"
+"   vertexColor = aColor;\n"
+"}\0";
+
+const char* vertexColorFragmentShaderSource = "#version 330 core\n"
+"in vec4 vertexColor;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   FragColor = vertexColor;\n"
+"}\n\0";
+
+const float backgroundColor[] = { 0.2f, 1.0f, 1.0f, 1.0f };
+
+struct StressOptions
+{
+    std::vector<int> houseCounts = { 1, 10, 100, 1000, 10000, 100000 };
+    int frameCount = 20;
+    std::string housePath = "house.scene";
+    std::string jsonPath = "stress.json";
+    std::string baselinePath = "stress_baseline.json";
+    bool saveBaseline = false;
+    double tolerancePercent = 10.0;
+    bool compactVertices = false;
+};
+
+StressOptions parseStressOptions(int argc, char** argv)
+{
+    StressOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(arg, "--houses") == 0 && hasValue)
+        {
+            options.houseCounts.clear();
+            std::stringstream list(argv[++i]);
+            std::string count;
+            while (std::getline(list, count, ','))
+                options.houseCounts.push_back(std::max(1, std::atoi(count.c_str())));
+        }
+        else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+            options.frameCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(arg, "--house") == 0 && hasValue)
+            options.housePath = argv[++i];
+        else if (std::strcmp(arg, "--json") == 0 && hasValue)
+            options.jsonPath = argv[++i];
+        else if (std::strcmp(arg, "--baseline") == 0 && hasValue)
+            options.baselinePath = argv[++i];
+        else if (std::strcmp(arg, "--save-baseline") == 0)
+            options.saveBaseline = true;
+        else if (std::strcmp(arg, "--tolerance") == 0 && hasValue)
+            options.tolerancePercent = std::max(0.0, std::atof(argv[++i]));
+        else if (std::strcmp(arg, "--compact") == 0)
+            options.compactVertices = true;
+        else
+            std::cerr << "Ignoring unknown option " << arg << std::endl;
+    }
+    return options;
+}
+
+// Largest resident set of the process so far, in bytes. GPU memory of a discrete card
+// is not part of it; with a software driver (llvmpipe) the buffers are.
+size_t peakMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+struct StressResult
+{
+    int houses = 0;
+    long long shapes = 0;
+    long long vertices = 0;
+    long long vertexBytes = 0;      // vertex buffer size in the format drawn
+    long long trianglesPerFrame = 0;
+    double drawsPerFrame = 0.0;
+    double framesPerSecond = 0.0;
+    double trianglesPerSecond = 0.0;
+    double peakMemoryMB = 0.0;
+    double cullMs = 0.0;            // one query of the shape grid
+    double visibleShapes = 0.0;     // shapes that query returned, on average
+    std::string regressions;        // what got worse than the baseline, empty if nothing did
+};
+
+// Value of "key": number on a line of the JSON this program writes; false if absent
+bool readJsonNumber(const std::string& line, const char* key, double& value)
+{
+    std::string quoted = std::string("\"") + key + "\":";
+    size_t at = line.find(quoted);
+    if (at == std::string::npos)
+        return false;
+    value = std::atof(line.c_str() + at + quoted.size());
+    return true;
+}
+
+// Value of "key": "string" on a line of the JSON this program writes; false if absent
+bool readJsonString(const std::string& line, const char* key, std::string& value)
+{
+    std::string quoted = std::string("\"") + key + "\": \"";
+    size_t at = line.find(quoted);
+    if (at == std::string::npos)
+        return false;
+    value.clear();
+    for (size_t i = at + quoted.size(); i < line.size() && line[i] != '"'; i++)
+    {
+        if (line[i] == '\\' && i + 1 < line.size())
+            i++;
+        value += line[i];
+    }
+    return true;
+}
+
+// An earlier run: what it was measured with, and a result per house count
+struct StressRun
+{
+    std::string renderer;
+    int frames = 0;
+    std::string vertexFormat;
+    std::vector<StressResult> results;
+};
+
+// Read a run from the JSON this program writes; an unreadable file gives no results
+StressRun readResults(const std::string& path)
+{
+    StressRun run;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        double houses, fps, trianglesPerSecond, peakMemoryMB, frames;
+        readJsonString(line, "renderer", run.renderer);
+        readJsonString(line, "vertex_format", run.vertexFormat);
+        if (readJsonNumber(line, "frames", frames))
+            run.frames = (int)frames;
+        if (readJsonNumber(line, "houses", houses) && readJsonNumber(line, "fps", fps)
+            && readJsonNumber(line, "triangles_per_second", trianglesPerSecond)
+            && readJsonNumber(line, "peak_memory_mb", peakMemoryMB))
+        {
+            StressResult result;
+            result.houses = (int)houses;
+            result.framesPerSecond = fps;
+            result.trianglesPerSecond = trianglesPerSecond;
+            result.peakMemoryMB = peakMemoryMB;
+            run.results.push_back(result);
+        }
+    }
+    return run;
+}
+
+bool writeResults(const std::string& path, const std::string& renderer, int frameCount, bool compactVertices,
+    const std::vector<StressResult>& results)
+{
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+
+    std::string escaped;
+    for (char c : renderer)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    std::fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"frames\": %d,\n  \"vertex_format\": \"%s\",\n  \"results\": [\n",
+        escaped.c_str(), frameCount, compactVertices ? "compact" : "float");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const StressResult& r = results[i];
+        std::fprintf(file, "    {\"houses\": %d, \"shapes\": %lld, \"vertices\": %lld, \"vertex_bytes\": %lld, "
+            "\"triangles_per_frame\": %lld, \"draws_per_frame\": %.1f, \"fps\": %.3f, \"triangles_per_second\": %.0f, "
+            "\"peak_memory_mb\": %.2f, \"cull_ms\": %.4f, \"visible_shapes\": %.0f, \"regression\": %s}%s\n",
+            r.houses, r.shapes, r.vertices, r.vertexBytes, r.trianglesPerFrame, r.drawsPerFrame, r.framesPerSecond,
+            r.trianglesPerSecond, r.peakMemoryMB, r.cullMs, r.visibleShapes, r.regressions.empty() ? "false" : "true",
+            i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+// Note in result.regressions every measure that is worse than the baseline's by more than
+// tolerance (a fraction)
+void compareWithBaseline(StressResult& result, const StressResult& baseline, double tolerance)
+{
+    if (result.framesPerSecond < baseline.framesPerSecond * (1.0 - tolerance))
+        result.regressions += " fps";
+    if (result.trianglesPerSecond < baseline.trianglesPerSecond * (1.0 - tolerance))
+        result.regressions += " triangles/s";
+    if (result.peakMemoryMB > baseline.peakMemoryMB * (1.0 + tolerance))
+        result.regressions += " memory";
+}
+
+int main(int argc, char** argv)
+{
+    StressOptions options = parseStressOptions(argc, argv);
+    std::sort(options.houseCounts.begin(), options.houseCounts.end());
+
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialize GLFW" << std::endl;
+        return -1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "stress_benchmark", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cerr << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    OffscreenTarget offscreen;
+    if (!offscreen.create(SCR_WIDTH, SCR_HEIGHT))
+    {
+        std::cerr << "Failed to create offscreen framebuffer" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    offscreen.bind();
+
+    ShaderCache shaderCache;
+    unsigned int flatShaderProgram = shaderCache.getProgram(vertexShaderSource, flatColorFragmentShaderSource);
+    unsigned int compactShaderProgram = shaderCache.getProgram(compactVertexShaderSource, vertexColorFragmentShaderSource);
+    if (flatShaderProgram == 0 || compactShaderProgram == 0)
+        return -1;
+    int colorLocation = glGetUniformLocation(flatShaderProgram, "color");
+    int boxLocation = glGetUniformLocation(compactShaderProgram, "positionBox");
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+
+    // results are only comparable when measured the same way
+    std::vector<StressResult> baselines;
+    if (!options.saveBaseline)
+    {
+        StressRun baseline = readResults(options.baselinePath);
+        const char* vertexFormat = options.compactVertices ? "compact" : "float";
+        if (!baseline.results.empty() && (baseline.renderer != renderer || baseline.frames != options.frameCount
+            || baseline.vertexFormat != vertexFormat))
+        {
+            std::cerr << "Not comparing with " << options.baselinePath << ": it was measured on " << baseline.renderer
+                << " with " << baseline.frames << " frames and " << baseline.vertexFormat << " vertices" << std::endl;
+        }
+        else
+            baselines = baseline.results;
+    }
+    std::cout << "GL (" << renderer << "), " << options.frameCount << " frames per size, "
+        << (options.compactVertices ? "compact" : "float") << " vertices";
+    if (!baselines.empty())
+        std::cout << ", comparing with " << options.baselinePath;
+    std::cout << std::endl;
+
+    std::vector<StressResult> results;
+    bool regressed = false;
+    float aspect = (float)SCR_WIDTH / SCR_HEIGHT;
+    for (int houses : options.houseCounts)
+    {
+        // Curves in the template are tessellated for the size a copy is drawn at, so a
+        // grid of tiny houses does not carry the segments of a full-screen moon
+        int columns, rows;
+        houseGridSize(houses, aspect, columns, rows);
+        TessellationSettings tessellation;
+        tessellation.pixelsPerUnitX = SCR_WIDTH / 2.0f / columns;
+        tessellation.pixelsPerUnitY = SCR_HEIGHT / 2.0f / rows;
+
+        SceneBatch house;
+        if (!parseSceneText(options.housePath.c_str(), house, tessellation))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        SceneBatch scene;
+        generateHouseGrid(house, houses, aspect, scene);
+        CompactBatch compactScene;
+        if (options.compactVertices)
+        {
+            compactScene.build(scene);
+            compactScene.upload();
+        }
+        else
+            scene.upload();
+
+        StressResult result;
+        result.houses = houses;
+        result.shapes = scene.shapeCount();
+        result.vertices = (long long)(scene.vertices().size() / 3);
+        result.vertexBytes = (long long)(options.compactVertices ? compactScene.vertexBytes() : scene.vertices().size() * sizeof(float));
+        result.trianglesPerFrame = batchTriangleCount(scene);
+
+        auto submitScene = [&](RenderQueue& queue)
+        {
+            if (options.compactVertices)
+                compactScene.submit(queue, 0, compactShaderProgram, boxLocation);
+            else
+                scene.submit(queue, 0, flatShaderProgram, colorLocation);
+        };
+
+        // one untimed frame so buffer setup stays out of the measurement
+        RenderQueue renderQueue;
+        GLStateCache glState;
+        submitScene(renderQueue);
+        renderQueue.sort();
+        renderQueue.execute(glState);
+        glFinish();
+
+        long long packets = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < options.frameCount; frame++)
+        {
+            glClearColor(backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3]);
+            glClear(GL_COLOR_BUFFER_BIT);
+            renderQueue.clear();
+            submitScene(renderQueue);
+            renderQueue.sort();
+            renderQueue.execute(glState);
+            packets += renderQueue.packetCount();
+        }
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result.drawsPerFrame = (double)packets / options.frameCount;
+        result.framesPerSecond = options.frameCount / seconds;
+        result.trianglesPerSecond = result.trianglesPerFrame * result.framesPerSecond;
+        result.peakMemoryMB = peakMemoryBytes() / (1024.0 * 1024.0);
+
+        // Culling: a quarter of the screen, a different part of it for every query
+        const float screen[4] = { -1.0f, -1.0f, 1.0f, 1.0f };
+        int cellColumns, cellRows;
+        SpatialGrid::suggestCells(screen, scene.shapeCount(), cellColumns, cellRows);
+        SpatialGrid shapeGrid;
+        shapeGrid.reset(screen, cellColumns, cellRows);
+        for (const BatchShape& shape : scene.shapes())
+        {
+            float box[4] = { 1e30f, 1e30f, -1e30f, -1e30f };
+            for (GLsizei i = 0; i < shape.count; i++)
+            {
+                const float* vertex = &scene.vertices()[(shape.first + i) * 3];
+                box[0] = std::min(box[0], vertex[0]);
+                box[1] = std::min(box[1], vertex[1]);
+                box[2] = std::max(box[2], vertex[0]);
+                box[3] = std::max(box[3], vertex[1]);
+            }
+            shapeGrid.insert(box);
+        }
+        std::vector<int> visible;
+        visible.reserve(scene.shapeCount());
+        long long visibleTotal = 0;
+        auto cullStart = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < options.frameCount; frame++)
+        {
+            float x = -1.0f + (float)frame / options.frameCount, y = -1.0f + (float)((frame * 7) % options.frameCount) / options.frameCount;
+            float view[4] = { x, y, x + 1.0f, y + 1.0f };
+            visible.clear();
+            visibleTotal += shapeGrid.query(view, visible);
+        }
+        result.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count() / options.frameCount;
+        result.visibleShapes = (double)visibleTotal / options.frameCount;
+
+        for (const StressResult& baseline : baselines)
+        {
+            if (baseline.houses == houses)
+                compareWithBaseline(result, baseline, options.tolerancePercent / 100.0);
+        }
+        regressed = regressed || !result.regressions.empty();
+
+        std::cout << houses << " houses: " << result.trianglesPerFrame << " triangles, " << result.vertexBytes
+            << " vertex bytes, " << result.drawsPerFrame << " draws/frame, " << result.framesPerSecond << " fps, " << result.trianglesPerSecond / 1e6
+            << " M triangles/s, peak " << result.peakMemoryMB << " MB; culling " << result.shapes << " shapes to "
+            << result.visibleShapes << " in " << result.cullMs << " ms";
+        if (!result.regressions.empty())
+            std::cout << "  REGRESSION:" << result.regressions;
+        std::cout << std::endl;
+        results.push_back(result);
+
+        scene.destroy();
+        compactScene.destroy();
+    }
+
+    if (!writeResults(options.jsonPath, renderer, options.frameCount, options.compactVertices, results))
+        std::cerr << "Failed to write " << options.jsonPath << std::endl;
+    if (options.saveBaseline)
+    {
+        if (writeResults(options.baselinePath, renderer, options.frameCount, options.compactVertices, results))
+            std::cout << "Saved baseline " << options.baselinePath << std::endl;
+        else
+            std::cerr << "Failed to write " << options.baselinePath << std::endl;
+    }
+
+    offscreen.destroy();
+    shaderCache.destroy();
+
+    // every buffer, vertex array and program above is back in the pool by now, so
+    // anything the report still counts as live was leaked
+    GLObjectPool::shared().report(std::cout);
+    GLObjectPool::shared().trim();
+    glfwTerminate();
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "affine_batch.h"
+#include "scene_batch.h"
+
+// Scenes of many houses for load testing.
+//
+// A house grid is count copies of a template scene (the house of house.scene) laid out
+// over the whole screen, each shrunk to fit its cell and nudged and scaled a little so
+// no two are exactly alike. Copies keep the template's shapes in order, so a scene of n
+// houses has n times its shapes, vertices and draw runs.
+
+// Columns and rows of the grid for count houses on a screen of the given aspect (width /
+// height), with cells about as wide as they are high in pixels
+inline void houseGridSize(int count, float aspect, int& columns, int& rows)
+{
+    columns = std::max(1, (int)std::ceil(std::sqrt(count * aspect)));
+    rows = std::max(1, (count + columns - 1) / columns);
+}
+
+// Append count copies of house, whose shapes lie within [-1, 1] on both axes, to scene
+inline void generateHouseGrid(const SceneBatch& house, int count, float aspect, SceneBatch& scene)
+{
+    int columns, rows;
+    houseGridSize(count, aspect, columns, rows);
+    float cellWidth = 2.0f / columns, cellHeight = 2.0f / rows;
+
+    const std::vector<float>& vertices = house.vertices();
+    size_t vertexCount = vertices.size() / 3;
+    std::vector<float> xs, ys, movedX(vertexCount), movedY(vertexCount), moved(vertices);
+    splitPositions(vertices.data(), vertexCount, xs, ys);
+
+    std::vector<int> colors;
+    for (size_t i = 0; i < house.colors().size(); i += 4)
+        colors.push_back(scene.addColor(&house.colors()[i]));
+
+    std::mt19937 random(1807102);
+    std::uniform_real_distribution<float> scale(0.8f, 1.0f);
+    std::uniform_real_distribution<float> nudge(-0.05f, 0.05f);
+    for (int copy = 0; copy < count; copy++)
+    {
+        // the template spans 2 x 2 units; a copy fills at most its cell, give or take the nudge
+        float s = scale(random);
+        Affine2D place;
+        place.a = 0.5f * cellWidth * s;
+        place.d = 0.5f * cellHeight * s;
+        place.tx = -1.0f + (copy % columns + 0.5f + nudge(random)) * cellWidth;
+        place.ty = 1.0f - (copy / columns + 0.5f + nudge(random)) * cellHeight;
+        transformPoints(place, xs.data(), ys.data(), movedX.data(), movedY.data(), vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            moved[i * 3] = movedX[i];
+            moved[i * 3 + 1] = movedY[i];
+        }
+
+        for (const BatchShape& shape : house.shapes())
+            scene.addShape(shape.mode, colors[shape.color], &moved[shape.first * 3], shape.count);
+    }
+}
+
+// Triangles a batch draws per frame, as GL counts them for each primitive mode
+inline long long batchTriangleCount(const SceneBatch& batch)
+{
+    long long triangles = 0;
+    for (const BatchShape& shape : batch.shapes())
+    {
+        if (shape.mode == GL_TRIANGLES)
+            triangles += shape.count / 3;
+        else if ((shape.mode == GL_TRIANGLE_STRIP || shape.mode == GL_TRIANGLE_FAN) && shape.count >= 3)
+            triangles += shape.count - 2;
+    }
+    return triangles;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Indexed triangle list: x, y, z vertices and three indices per triangle
+struct TriangleMesh
+{
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+
+    int vertexCount() const { return (int)(vertices.size() / 3); }
+    int triangleCount() const { return (int)(indices.size() / 3); }
+
+    void clear()
+    {
+        vertices.clear();
+        indices.clear();
+    }
+
+    uint32_t addVertex(float x, float y, float z = 0.0f)
+    {
+        vertices.push_back(x);
+        vertices.push_back(y);
+        vertices.push_back(z);
+        return (uint32_t)(vertices.size() / 3 - 1);
+    }
+
+    void addTriangle(uint32_t a, uint32_t b, uint32_t c)
+    {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    // The triangles as plain GL_TRIANGLES vertices, for consumers without index buffers
+    void expand(std::vector<float>& out) const
+    {
+        out.resize(indices.size() * 3);
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            const float* vertex = &vertices[indices[i] * 3];
+            out[i * 3] = vertex[0];
+            out[i * 3 + 1] = vertex[1];
+            out[i * 3 + 2] = vertex[2];
+        }
+    }
+};
+
+// How finely curves are cut: no point of a curve lies further than maxPixelError pixels
+// from its polygon. Shapes are given in NDC, so the pixel size comes from the target's
+// NDC-to-pixel scale (half the framebuffer size).
+struct TessellationSettings
+{
+    float maxPixelError = 0.25f;
+    float pixelsPerUnitX = 960.0f;
+    float pixelsPerUnitY = 540.0f;
+    int threadCount = 0;    // 0: one per core
+};
+
+// Number of chords that follow an arc of radius pixels through sweep radians with
+// no gap wider than maxError pixels. A chord spanning angle a sags r * (1 - cos(a / 2))
+// below the arc, so each chord may span 2 * acos(1 - maxError / r).
+inline int arcSegmentCount(float radius, float sweep, float maxError)
+{
+    const int maxSegments = 4096;
+    sweep = std::fabs(sweep);
+    if (radius <= maxError)
+        return std::max(1, (int)std::ceil(sweep / 2.0943951f));   // a triangle for a full circle
+    float step = 2.0f * std::acos(1.0f - maxError / radius);
+    int segments = (int)std::ceil(sweep / step);
+    return std::min(std::max(segments, sweep >= 6.2831853f ? 3 : 1), maxSegments);
+}
+
+// An ellipse, or the pie slice of one from startAngle through sweep (radians,
+// counter-clockwise), as a fan of triangles around its center. The segment count is
+// picked from the larger radius in pixels so the error bound holds all the way round.
+inline void tessellateEllipse(float cx, float cy, float rx, float ry, float startAngle, float sweep,
+    const TessellationSettings& settings, TriangleMesh& mesh)
+{
+    float radius = std::max(std::fabs(rx) * settings.pixelsPerUnitX, std::fabs(ry) * settings.pixelsPerUnitY);
+    int segments = arcSegmentCount(radius, sweep, settings.maxPixelError);
+    bool closed = std::fabs(sweep) >= 6.2831853f;
+    int rimCount = closed ? segments : segments + 1;
+
+    uint32_t center = mesh.addVertex(cx, cy);
+    for (int i = 0; i < rimCount; i++)
+    {
+        float angle = startAngle + sweep * i / segments;
+        mesh.addVertex(cx + rx * std::cos(angle), cy + ry * std::sin(angle));
+    }
+    for (int i = 0; i < segments; i++)
+        mesh.addTriangle(center, center + 1 + i, center + 1 + (i + 1) % rimCount);
+}
+
+// Split a simple polygon (x, y pairs, either winding, no self intersections) into
+// triangles by ear clipping. Returns false when clipping gets stuck with no ear left,
+// which self-intersecting outlines can cause; the part not yet clipped is left out.
+inline bool triangulatePolygon(const float* points, int pointCount, TriangleMesh& mesh)
+{
+    if (pointCount < 3)
+        return false;
+
+    uint32_t base = (uint32_t)mesh.vertexCount();
+    for (int i = 0; i < pointCount; i++)
+        mesh.addVertex(points[i * 2], points[i * 2 + 1]);
+
+    // walk the outline counter-clockwise so convex corners have a positive cross product
+    double area = 0.0;
+    for (int i = 0, j = pointCount - 1; i < pointCount; j = i++)
+        area += (double)points[j * 2] * points[i * 2 + 1] - (double)points[i * 2] * points[j * 2 + 1];
+    std::vector<int> remaining(pointCount);
+    for (int i = 0; i < pointCount; i++)
+        remaining[i] = area >= 0.0 ? i : pointCount - 1 - i;
+
+    auto x = [&](int i) { return (double)points[i * 2]; };
+    auto y = [&](int i) { return (double)points[i * 2 + 1]; };
+    auto cross = [&](int a, int b, int c) { return (x(b) - x(a)) * (y(c) - y(a)) - (y(b) - y(a)) * (x(c) - x(a)); };
+
+    // a corner is an ear when it is convex and no other remaining corner lies inside
+    // (or on) the triangle it cuts off
+    auto isEar = [&](size_t at)
+    {
+        size_t n = remaining.size();
+        int a = remaining[(at + n - 1) % n], b = remaining[at], c = remaining[(at + 1) % n];
+        if (cross(a, b, c) <= 0.0)
+            return false;
+        for (size_t k = 0; k < n; k++)
+        {
+            int p = remaining[k];
+            if (p == a || p == b || p == c)
+                continue;
+            if (cross(a, b, p) >= 0.0 && cross(b, c, p) >= 0.0 && cross(c, a, p) >= 0.0)
+                return false;
+        }
+        return true;
+    };
+
+    size_t at = 0, sinceLastEar = 0;
+    while (remaining.size() > 3)
+    {
+        size_t n = remaining.size();
+        if (sinceLastEar > n)
+        {
+            // no ear anywhere: drop a corner that encloses no area, or give up
+            size_t flat = n;
+            for (size_t k = 0; k < n && flat == n; k++)
+            {
+                if (cross(remaining[(k + n - 1) % n], remaining[k], remaining[(k + 1) % n]) == 0.0)
+                    flat = k;
+            }
+            if (flat == n)
+                return false;
+            remaining.erase(remaining.begin() + flat);
+            sinceLastEar = 0;
+            continue;
+        }
+
+        at %= n;
+        if (isEar(at))
+        {
+            mesh.addTriangle(base + remaining[(at + n - 1) % n], base + remaining[at], base + remaining[(at + 1) % n]);
+            remaining.erase(remaining.begin() + at);
+            sinceLastEar = 0;
+        }
+        else
+        {
+            at++;
+            sinceLastEar++;
+        }
+    }
+    if (cross(remaining[0], remaining[1], remaining[2]) != 0.0)
+        mesh.addTriangle(base + remaining[0], base + remaining[1], base + remaining[2]);
+    return true;
+}
+
+// One shape to tessellate: an ellipse or arc, or a polygon outline
+struct TessellationShape
+{
+    enum Kind { Ellipse, Polygon };
+
+    Kind kind = Ellipse;
+    float cx = 0.0f, cy = 0.0f, rx = 0.0f, ry = 0.0f;
+    float startAngle = 0.0f, sweep = 6.2831853f;
+    std::vector<float> outline;     // x, y pairs of a polygon
+};
+
+// Tessellate every shape into its own mesh, spread over the settings' thread count.
+// Returns how many polygons could not be fully triangulated.
+inline int tessellateShapes(const std::vector<TessellationShape>& shapes, std::vector<TriangleMesh>& meshes,
+    const TessellationSettings& settings)
+{
+    meshes.resize(shapes.size());
+    std::vector<char> failed(shapes.size(), 0);
+    auto tessellate = [&](int index, int)
+    {
+        const TessellationShape& shape = shapes[index];
+        TriangleMesh& mesh = meshes[index];
+        mesh.clear();
+        if (shape.kind == TessellationShape::Ellipse)
+            tessellateEllipse(shape.cx, shape.cy, shape.rx, shape.ry, shape.startAngle, shape.sweep, settings, mesh);
+        else if (!triangulatePolygon(shape.outline.data(), (int)shape.outline.size() / 2, mesh))
+            failed[index] = 1;
+    };
+
+    int threads = settings.threadCount;
+    if (threads == 0)
+        threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, (int)shapes.size());
+    if (threads <= 1)
+    {
+        for (int i = 0; i < (int)shapes.size(); i++)
+            tessellate(i, 0);
+    }
+    else
+    {
+        ThreadPool pool(threads);
+        pool.parallelFor((int)shapes.size(), tessellate);
+    }
+    return (int)std::count(failed.begin(), failed.end(), 1);
+}
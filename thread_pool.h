@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run parallelFor() jobs with work stealing.
+//
+// A job's indices are split into one contiguous range per thread. Each thread takes
+// indices from the front of its own range; a thread that runs dry steals the back half
+// of another thread's range and carries on with that. Ranges are single 64-bit atomics
+// (begin and end packed together) updated with compare-and-swap, so handing out work
+// takes no locks. The calling thread works as thread 0, so a pool of one thread simply
+// runs the job inline.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount = 1)
+    {
+        threadCount_ = std::max(1, threadCount);
+        ranges_.reset(new Range[threadCount_]);
+        for (int i = 1; i < threadCount_; i++)
+            workers_.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int threadCount() const { return threadCount_; }
+
+    // Call job(index, thread) for every index in [0, count) and return when all are done
+    void parallelFor(int count, const std::function<void(int, int)>& job)
+    {
+        if (count <= 0)
+            return;
+        if (threadCount_ == 1)
+        {
+            for (int i = 0; i < count; i++)
+                job(i, 0);
+            return;
+        }
+
+        for (int i = 0; i < threadCount_; i++)
+        {
+            uint32_t begin = (uint32_t)((int64_t)count * i / threadCount_);
+            uint32_t end = (uint32_t)((int64_t)count * (i + 1) / threadCount_);
+            ranges_[i].bounds.store(pack(begin, end));
+        }
+        job_ = &job;
+        busy_.store(threadCount_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_++;
+        }
+        wake_.notify_all();
+
+        runJob(0);
+        while (busy_.load() > 0)
+            std::this_thread::yield();
+        job_ = NULL;
+    }
+
+private:
+    // padded to a cache line so threads working their own ranges do not share lines
+    struct Range
+    {
+        std::atomic<uint64_t> bounds{ 0 };
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t)begin << 32 | end; }
+
+    // Take the next index of the thread's own range, or -1 when it is empty
+    int take(int thread)
+    {
+        std::atomic<uint64_t>& bounds = ranges_[thread].bounds;
+        uint64_t current = bounds.load();
+        for (;;)
+        {
+            uint32_t begin = (uint32_t)(current >> 32), end = (uint32_t)current;
+            if (begin >= end)
+                return -1;
+            if (bounds.compare_exchange_weak(current, pack(begin + 1, end)))
+                return (int)begin;
+        }
+    }
+
+    // Move the back half of some other thread's range into the thread's own (empty)
+    // range and return its first index, or -1 when every range is empty
+    int steal(int thread)
+    {
+        for (int offset = 1; offset < threadCount_; offset++)
+        {
+            std::atomic<uint64_t>& victim = ranges_[(thread + offset) % threadCount_].bounds;
+            uint64_t current = victim.load();
+            for (;;)
+            {
+                uint32_t begin = (uint32_t)(current >> 32), end = (uint32_t)current;
+                if (begin >= end)
+                    break;
+                uint32_t split = end - (end - begin + 1) / 2;
+                if (victim.compare_exchange_weak(current, pack(begin, split)))
+                {
+                    ranges_[thread].bounds.store(pack(split + 1, end));
+                    return (int)split;
+                }
+            }
+        }
+        return -1;
+    }
+
+    void runJob(int thread)
+    {
+        const std::function<void(int, int)>& job = *job_;
+        for (;;)
+        {
+            int index = take(thread);
+            if (index < 0)
+                index = steal(thread);
+            if (index < 0)
+                break;
+            job(index, thread);
+        }
+        busy_.fetch_sub(1);
+    }
+
+    void workerLoop(int thread)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&]() { return stopping_ || generation_ != seen; });
+                if (stopping_)
+                    return;
+                seen = generation_;
+            }
+            runJob(thread);
+        }
+    }
+
+    int threadCount_ = 1;
+    std::unique_ptr<Range[]> ranges_;
+    std::vector<std::thread> workers_;
+
+    const std::function<void(int, int)>* job_ = NULL;
+    std::atomic<int> busy_{ 0 };
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+};
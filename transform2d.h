@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// Translate/rotate/scale of a 2D object, composed as translate * rotate * scale.
+//
+// The matrix is written directly in closed form instead of multiplying three 4x4
+// matrices, and only when one of the parts changed since it was last asked for.
+// version() changes with every edit, so callers can skip re-uploading a matrix that
+// the GPU already has.
+class Transform2D
+{
+public:
+    void setTranslation(float x, float y) { translateX_ = x; translateY_ = y; touch(); }
+    void setRotation(float degrees) { rotateAngle_ = degrees; touch(); }
+    void setScale(float x, float y) { scaleX_ = x; scaleY_ = y; touch(); }
+
+    void translate(float dx, float dy) { setTranslation(translateX_ + dx, translateY_ + dy); }
+    void rotate(float degrees) { setRotation(rotateAngle_ + degrees); }
+    void scale(float dx, float dy) { setScale(scaleX_ + dx, scaleY_ + dy); }
+
+    // Set every part to the blend of from and to at t (0 gives from, 1 gives to), for
+    // drawing a state between two simulation steps. The version only changes when the
+    // result differs from the current parts.
+    void interpolate(const Transform2D& from, const Transform2D& to, float t)
+    {
+        float translateX = from.translateX_ + (to.translateX_ - from.translateX_) * t;
+        float translateY = from.translateY_ + (to.translateY_ - from.translateY_) * t;
+        float rotateAngle = from.rotateAngle_ + (to.rotateAngle_ - from.rotateAngle_) * t;
+        float scaleX = from.scaleX_ + (to.scaleX_ - from.scaleX_) * t;
+        float scaleY = from.scaleY_ + (to.scaleY_ - from.scaleY_) * t;
+        if (translateX == translateX_ && translateY == translateY_ && rotateAngle == rotateAngle_
+            && scaleX == scaleX_ && scaleY == scaleY_)
+            return;
+        translateX_ = translateX;
+        translateY_ = translateY;
+        rotateAngle_ = rotateAngle;
+        scaleX_ = scaleX;
+        scaleY_ = scaleY;
+        touch();
+    }
+
+    float translateX() const { return translateX_; }
+    float translateY() const { return translateY_; }
+    float rotateAngle() const { return rotateAngle_; }
+    float scaleX() const { return scaleX_; }
+    float scaleY() const { return scaleY_; }
+
+    const glm::mat4& matrix() const
+    {
+        if (dirty_)
+        {
+            float radians = rotateAngle_ * 0.01745329251994329577f;
+            float c = std::cos(radians);
+            float s = std::sin(radians);
+
+            matrix_ = glm::mat4(1.0f);
+            matrix_[0][0] = scaleX_ * c;
+            matrix_[0][1] = scaleX_ * s;
+            matrix_[1][0] = -scaleY_ * s;
+            matrix_[1][1] = scaleY_ * c;
+            matrix_[3][0] = translateX_;
+            matrix_[3][1] = translateY_;
+            dirty_ = false;
+        }
+        return matrix_;
+    }
+
+    unsigned int version() const { return version_; }
+
+private:
+    void touch()
+    {
+        dirty_ = true;
+        version_++;
+    }
+
+    float translateX_ = 0.0f;
+    float translateY_ = 0.0f;
+    float rotateAngle_ = 0.0f;
+    float scaleX_ = 1.0f;
+    float scaleY_ = 1.0f;
+
+    mutable glm::mat4 matrix_;
+    mutable bool dirty_ = true;
+    unsigned int version_ = 1;
+};
@@ -5,153 +5,156 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include "frame_capture.h"
+#include "frame_pipeline.h"
+#include "frame_profiler.h"
+#include "gl_objects.h"
+#include "instanced_shape.h"
+#include "mesh_builder.h"
+#include "offscreen.h"
+#include "redraw_tracker.h"
+#include "render_queue.h"
+#include "render_options.h"
+#include "scene_batch.h"
+#include "scene_file.h"
+#include "scene_graph.h"
+#include "shader_cache.h"
+#include "soft_raster.h"
+#include "spatial_grid.h"
+#include "tessellate.h"
+#include "vertex_layout.h"
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
 
+// vertices are placed by their scene graph node's world transform (see scene_graph.h)
 const char* vertexShaderSource = "#version 330 core\n"
 "layout (location = 0) in vec3 aPos;\n"
+"uniform samplerBuffer worldMatrices;\n"
+"uniform int node;\n"
 "void main()\n"
 "{\n"
-"   gl_Position = vec4(aPos, 1.0);\n"
+"   vec4 row0 = texelFetch(worldMatrices, node * 2);\n"
+"   vec4 row1 = texelFetch(worldMatrices, node * 2 + 1);\n"
+"   vec3 p = vec3(aPos.xy, 1.0);\n"
+"   gl_Position = vec4(dot(row0.xyz, p), dot(row1.xyz, p), aPos.z, 1.0);\n"
 "}\0";
 
 
-const char* squareFragmentShaderSource = "#version 330 core\n"
+const char* flatColorFragmentShaderSource = "#version 330 core\n"
 "out vec4 FragColor;\n"
+"uniform vec4 color;\n"
 "void main()\n"
 "{\n"
-"   FragColor = vec4(0.0, 0.0, 0.1, 1.0); // orange color\n"
+"   FragColor = color;\n"
 "}\n\0";
 
-const char* triangleFragmentShaderSource = "#version 330 core\n"
-"out vec4 FragColor;\n"
+// instanced shapes: a shared template placed and colored per instance
+const char* instancedVertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec3 aPos;\n"
+"layout (location = 1) in vec4 aOffsetScale;\n"
+"layout (location = 2) in vec4 aColor;\n"
+"uniform samplerBuffer worldMatrices;\n"
+"uniform int node;\n"
+"out vec4 instanceColor;\n"
 "void main()\n"
 "{\n"
-"   FragColor = vec4(1.0, 0.84, 0.0, 1.0); // gold color\n"
-"}\n\0";
+"   vec4 row0 = texelFetch(worldMatrices, node * 2);\n"
+"   vec4 row1 = texelFetch(worldMatrices, node * 2 + 1);\n"
+"   vec3 p = vec3(aPos.xy * aOffsetScale.zw + aOffsetScale.xy, 1.0);\n"
+"   gl_Position = vec4(dot(row0.xyz, p), dot(row1.xyz, p), aPos.z, 1.0);\n"
+"   instanceColor = aColor;\n"
+"}\0";
 
-const char* triangle2FragmentShaderSource = "#version 330 core\n"
+const char* instancedFragmentShaderSource = "#version 330 core\n"
+"in vec4 instanceColor;\n"
 "out vec4 FragColor;\n"
 "void main()\n"
 "{\n"
-"   FragColor = vec4(1.0, 0.2, 0.2, 1.0); // Blue color\n"
+"   FragColor = instanceColor;\n"
 "}\n\0";
 
-const char* cmniFragmentShaderSource = "#version 330 core\n"
-"out vec4 FragColor;\n"
+// --compact: 16-bit positions relative to the bounding box of their range and a color
+// per vertex (see vertex_layout.h)
+const char* compactVertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec2 aPos;\n"
+"layout (location = 1) in vec4 aColor;\n"
+"uniform vec4 positionBox;\n"
+"uniform samplerBuffer worldMatrices;\n"
+"uniform int node;\n"
+"out vec4 vertexColor;\n"
 "void main()\n"
 "{\n"
-"   FragColor = vec4(.8, .8, .8, 1.0); // Blue color\n"
-"}\n\0";
-
+"   vec4 row0 = texelFetch(worldMatrices, node * 2);\n"
+"   vec4 row1 = texelFetch(worldMatrices, node * 2 + 1);\n"
+"   vec3 p = vec3(positionBox.xy + aPos * positionBox.zw, 1.0);\n"
+"   gl_Position = vec4(dot(row0.xyz, p), dot(row1.xyz, p), 0.0, 1.0);\n"
+"   vertexColor = aColor;\n"
+"}\0";
 
-const char* circleFragmentShaderSource = "#version 330 core\n"
+const char* vertexColorFragmentShaderSource = "#version 330 core\n"
+"in vec4 vertexColor;\n"
 "out vec4 FragColor;\n"
 "void main()\n"
 "{\n"
-"   FragColor = vec4(1.0, 1.0, 1.0, 1.0); // Blue color\n"
+"   FragColor = vertexColor;\n"
 "}\n\0";
 
-const char* windowFragmentShaderSource = "#version 330 core\n"
-"out vec4 FragColor;\n"
-"void main()\n"
-"{\n"
-"   FragColor = vec4(0.0, 0.0, 0.0, 1.0); // Blue color\n"
-"}\n\0";
+const float backgroundColor[] = { 0.2f, 1.0f, 1.0f, 1.0f };
 
-const char* win1FragmentShaderSource = "#version 330 core\n"
-"out vec4 FragColor;\n"
-"void main()\n"
-"{\n"
-"   FragColor = vec4(0.376, 0.376, 0.376, 1.0); // Blue color\n"
-"}\n\0";
+// colors of the house parts, fed to the flat color program's uniform
+const float squareColor[] = { 0.0f, 0.0f, 0.1f, 1.0f };
+const float triangleColor[] = { 1.0f, 0.84f, 0.0f, 1.0f }; // gold color
+const float triangle2Color[] = { 1.0f, 0.2f, 0.2f, 1.0f };
+const float cmniColor[] = { 0.8f, 0.8f, 0.8f, 1.0f };
+const float circleColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+const float windowColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+const float win1Color[] = { 0.376f, 0.376f, 0.376f, 1.0f };
+const float glassColor[] = { 0.6f, 0.8f, 1.0f, 1.0f };
 
-const char* glassFragmentShaderSource = "#version 330 core\n"
-"out vec4 FragColor;\n"
-"void main()\n"
-"{\n"
-"   FragColor = vec4(0.6, 0.8, 1.0, 1.0); // Blue color\n"
-"}\n\0";
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+// The house hangs under a root node of the scene graph, so it moves as one unit
+SceneGraph sceneGraph;
+int houseNode = -1;
 
-int main()
-{
-    // Initialize GLFW
-    if (!glfwInit())
-    {
-        std::cerr << "Failed to initialize GLFW" << std::endl;
-        return -1;
-    }
+// On demand, frames are only drawn after something marked them here
+RedrawTracker redraw;
 
-    // Configure GLFW
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+// Arrow keys held in a frame, as bits
+enum ArrowKeys { KeyLeft = 1, KeyRight = 2, KeyUp = 4, KeyDown = 8 };
 
-    // Create a GLFW window
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "OpenGL Example", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cerr << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-
-    // Initialize GLAD
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cerr << "Failed to initialize GLAD" << std::endl;
-        return -1;
-    }
-
-    // Compile and link the shaders for the square
-    unsigned int squareVertexShader, squareFragmentShader, squareShaderProgram;
-    squareVertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(squareVertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(squareVertexShader);
-
-    int success;
-    char infoLog[512];
-    glGetShaderiv(squareVertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(squareVertexShader, 512, NULL, infoLog);
-        std::cerr << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    squareFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(squareFragmentShader, 1, &squareFragmentShaderSource, NULL);
-    glCompileShader(squareFragmentShader);
-
-    glGetShaderiv(squareFragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(squareFragmentShader, 512, NULL, infoLog);
-        std::cerr << "Fragment shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
+// What the GL thread needs to draw a frame; built on the main thread or, with
+// --threaded, a frame ahead on a worker
+struct PreparedFrame
+{
+    bool moved = false;
+    bool transformsChanged = false;
+    std::vector<float> worldRows;   // the scene graph's world transforms, when they changed
+    int oldRect[4] = {};            // the house on screen before and after this frame
+    int newRect[4] = {};
+    bool culled = false;            // the house is off screen and nothing was queued
+    std::vector<int> visibleRanges; // ranges of the indexed batch that are on screen
+    int culledRanges = 0;
+    RenderQueue queue;              // sorted draws
+};
 
-    squareShaderProgram = glCreateProgram();
-    glAttachShader(squareShaderProgram, squareVertexShader);
-    glAttachShader(squareShaderProgram, squareFragmentShader);
-    glLinkProgram(squareShaderProgram);
-    glDeleteShader(squareVertexShader);
-    glDeleteShader(squareFragmentShader);
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
+int sampleInput(GLFWwindow* window);
+bool applyInput(int keys);
+void screenRect(const glm::mat4& world, const float* bounds, int width, int height, int rect[4]);
 
-    glGetProgramiv(squareShaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(squareShaderProgram, 512, NULL, infoLog);
-        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
-        return -1;
-    }
+int main(int argc, char** argv)
+{
+    RenderOptions options = parseRenderOptions(argc, argv);
 
     // Define vertices for the square
     float squareVertices[] = {
@@ -162,62 +165,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareVAO, squareVBO;
-    glGenVertexArrays(1, &squareVAO);
-    glGenBuffers(1, &squareVBO);
-
-    glBindVertexArray(squareVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareVertices), squareVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    //window fragment
-
-    unsigned int windowVertexShader, windowFragmentShader, windowShaderProgram;
-    windowVertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(windowVertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(windowVertexShader);
-
-    glGetShaderiv(windowVertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(windowVertexShader, 512, NULL, infoLog);
-        std::cerr << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    windowFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(windowFragmentShader, 1, &windowFragmentShaderSource, NULL);
-    glCompileShader(windowFragmentShader);
-
-    glGetShaderiv(windowFragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(windowFragmentShader, 512, NULL, infoLog);
-        std::cerr << "Fragment shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    windowShaderProgram = glCreateProgram();
-    glAttachShader(windowShaderProgram, windowVertexShader);
-    glAttachShader(windowShaderProgram, windowFragmentShader);
-    glLinkProgram(windowShaderProgram);
-    glDeleteShader(windowVertexShader);
-    glDeleteShader(windowFragmentShader);
-
-    glGetProgramiv(windowShaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(windowShaderProgram, 512, NULL, infoLog);
-        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-    
-
 
     //window
         // Define vertices for the square
@@ -229,22 +176,10 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindowVAO, squareWindowVBO;
-    glGenVertexArrays(1, &squareWindowVAO);
-    glGenBuffers(1, &squareWindowVBO);
-
-    glBindVertexArray(squareWindowVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindowVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindowVertices), squareWindowVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float squareWindow1Vertices[] = {
-    
+
    // 0.45005701f,  0.112083808f, 0.0f,
     0.532690792f, 0.100272423f, 0.0f,
     0.532690792f, 0.242115566f, 0.0f,
@@ -252,19 +187,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow1VAO, squareWindow1VBO;
-    glGenVertexArrays(1, &squareWindow1VAO);
-    glGenBuffers(1, &squareWindow1VBO);
-
-    glBindVertexArray(squareWindow1VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow1VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow1Vertices), squareWindow1Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
 
     // Define vertices for the square
     float squareWindow2Vertices[] = {
@@ -275,18 +197,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow2VAO, squareWindow2VBO;
-    glGenVertexArrays(1, &squareWindow2VAO);
-    glGenBuffers(1, &squareWindow2VBO);
-
-    glBindVertexArray(squareWindow2VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow2VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow2Vertices), squareWindow2Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float squareWindow3Vertices[] = {
@@ -296,18 +206,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow3VAO, squareWindow3VBO;
-    glGenVertexArrays(1, &squareWindow3VAO);
-    glGenBuffers(1, &squareWindow3VBO);
-
-    glBindVertexArray(squareWindow3VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow3VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow3Vertices), squareWindow3Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float squareWindow4Vertices[] = {
@@ -317,40 +215,16 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow4VAO, squareWindow4VBO;
-    glGenVertexArrays(1, &squareWindow4VAO);
-    glGenBuffers(1, &squareWindow4VBO);
-
-    glBindVertexArray(squareWindow4VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow4VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow4Vertices), squareWindow4Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float squareWindow5Vertices[] = {
      0.732690792f, 0.08700272423f, 0.0f,
     0.732690792f, 0.202115566f, 0.0f,
     0.653867875f, 	0.222115566f, 0.0f
-    
-    };
 
+    };
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow5VAO, squareWindow5VBO;
-    glGenVertexArrays(1, &squareWindow5VAO);
-    glGenBuffers(1, &squareWindow5VBO);
 
-    glBindVertexArray(squareWindow5VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow5VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow5Vertices), squareWindow5Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float squareWindow6Vertices[] = {
@@ -360,18 +234,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow6VAO, squareWindow6VBO;
-    glGenVertexArrays(1, &squareWindow6VAO);
-    glGenBuffers(1, &squareWindow6VBO);
-
-    glBindVertexArray(squareWindow6VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow6VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow6Vertices), squareWindow6Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float squareWindow7Vertices[] = {
@@ -381,18 +243,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-    unsigned int squareWindow7VAO, squareWindow7VBO;
-    glGenVertexArrays(1, &squareWindow7VAO);
-    glGenBuffers(1, &squareWindow7VBO);
-
-    glBindVertexArray(squareWindow7VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, squareWindow7VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(squareWindow7Vertices), squareWindow7Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the square
     float cimniupVertices[] = {
@@ -401,40 +251,16 @@ int main()
      0.870839997f, 	0.898392626f, 0.0f
     };
 
-    // Create VAO and VBO for the square
-    unsigned int cimniupVAO, cimniupVBO;
-    glGenVertexArrays(1, &cimniupVAO);
-    glGenBuffers(1, &cimniupVBO);
-
-    glBindVertexArray(cimniupVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cimniupVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cimniupVertices), cimniupVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
 
     float cimniup1Vertices[] = {
  0.870839997f, 	0.898392626f, 0.0f,
  0.870839997f, 0.948392626f, 0.0f,
  0.807115145f, 0.948392626f, 0.0f
- 
+
     };
 
-    // Create VAO and VBO for the square
-    unsigned int cimniup1VAO, cimniup1VBO;
-    glGenVertexArrays(1, &cimniup1VAO);
-    glGenBuffers(1, &cimniup1VBO);
 
-    glBindVertexArray(cimniup1VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cimniup1VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cimniup1Vertices), cimniup1Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-   
 
     // Define vertices for the square
     float lineVertices[] = {
@@ -443,61 +269,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the square
-     unsigned int lineVAO, lineVBO;
-    glGenVertexArrays(1, &lineVAO);
-    glGenBuffers(1, &lineVBO);
-
-    glBindVertexArray(lineVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(lineVertices), lineVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    
-
-
-    // Compile and link the shaders for the triangle
-    unsigned int triangleVertexShader, triangleFragmentShader, triangleShaderProgram;
-    triangleVertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(triangleVertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(triangleVertexShader);
-
-    glGetShaderiv(triangleVertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(triangleVertexShader, 512, NULL, infoLog);
-        std::cerr << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    triangleFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(triangleFragmentShader, 1, &triangleFragmentShaderSource, NULL);
-    glCompileShader(triangleFragmentShader);
-
-    glGetShaderiv(triangleFragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(triangleFragmentShader, 512, NULL, infoLog);
-        std::cerr << "Fragment shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    triangleShaderProgram = glCreateProgram();
-    glAttachShader(triangleShaderProgram, triangleVertexShader);
-    glAttachShader(triangleShaderProgram, triangleFragmentShader);
-    glLinkProgram(triangleShaderProgram);
-    glDeleteShader(triangleVertexShader);
-    glDeleteShader(triangleFragmentShader);
-
-    glGetProgramiv(triangleShaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(triangleShaderProgram, 512, NULL, infoLog);
-        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
-        return -1;
-    }
 
     // Define vertices for the triangle
     float triangleVertices[] = {
@@ -506,18 +277,6 @@ int main()
        0.914550157f, -0.054878749f, 0.0f  // top
     };
 
-    // Create VAO and VBO for the triangle
-    unsigned int triangleVAO, triangleVBO;
-    glGenVertexArrays(1, &triangleVAO);
-    glGenBuffers(1, &triangleVBO);
-
-    glBindVertexArray(triangleVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertices), triangleVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     // Define vertices for the triangle3
     float triangle3Vertices[] = {
@@ -527,60 +286,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the triangle3
-    unsigned int triangle3VAO, triangle3VBO;
-    glGenVertexArrays(1, &triangle3VAO);
-    glGenBuffers(1, &triangle3VBO);
-
-    glBindVertexArray(triangle3VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, triangle3VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(triangle3Vertices), triangle3Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-
-    // Compile and link the shaders for the triangle2
-    unsigned int triangle2VertexShader, triangle2FragmentShader, triangle2ShaderProgram;
-    triangle2VertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(triangle2VertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(triangle2VertexShader);
-
-    glGetShaderiv(triangle2VertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(triangle2VertexShader, 512, NULL, infoLog);
-        std::cerr << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    triangle2FragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(triangle2FragmentShader, 1, &triangle2FragmentShaderSource, NULL);
-    glCompileShader(triangle2FragmentShader);
-
-    glGetShaderiv(triangle2FragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(triangle2FragmentShader, 512, NULL, infoLog);
-        std::cerr << "Fragment shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    triangle2ShaderProgram = glCreateProgram();
-    glAttachShader(triangle2ShaderProgram, triangle2VertexShader);
-    glAttachShader(triangle2ShaderProgram, triangle2FragmentShader);
-    glLinkProgram(triangle2ShaderProgram);
-    glDeleteShader(triangle2VertexShader);
-    glDeleteShader(triangle2FragmentShader);
-
-    glGetProgramiv(triangle2ShaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(triangle2ShaderProgram, 512, NULL, infoLog);
-        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
-        return -1;
-    }
 
     // Define vertices for the triangle2
     float triangle2Vertices[] = {
@@ -589,18 +294,6 @@ int main()
          0.921272737f, -0.733989394f, 0.0f
     };
 
-    // Create VAO and VBO for the triangle2
-    unsigned int triangle2VAO, triangle2VBO;
-    glGenVertexArrays(1, &triangle2VAO);
-    glGenBuffers(1, &triangle2VBO);
-
-    glBindVertexArray(triangle2VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, triangle2VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(triangle2Vertices), triangle2Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
 
     // Define vertices for the triangle4
@@ -611,18 +304,6 @@ int main()
     };
 
 
-    // Create VAO and VBO for the triangle4
-    unsigned int triangle4VAO, triangle4VBO;
-    glGenVertexArrays(1, &triangle4VAO);
-    glGenBuffers(1, &triangle4VBO);
-
-    glBindVertexArray(triangle4VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, triangle4VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(triangle4Vertices), triangle4Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     float cimniup2Vertices[] = {
      0.645375309f, 0.813711461f, 0.0f,
@@ -631,18 +312,6 @@ int main()
 
     };
 
-    // Create VAO and VBO for the square
-    unsigned int cimniup2VAO, cimniup2VBO;
-    glGenVertexArrays(1, &cimniup2VAO);
-    glGenBuffers(1, &cimniup2VBO);
-
-    glBindVertexArray(cimniup2VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cimniup2VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cimniup2Vertices), cimniup2Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
     float cimniup3Vertices[] = {
       0.711093596f, 0.763711461f, 0.0f,
@@ -651,59 +320,7 @@ int main()
 
     };
 
-    // Create VAO and VBO for the square
-    unsigned int cimniup3VAO, cimniup3VBO;
-    glGenVertexArrays(1, &cimniup3VAO);
-    glGenBuffers(1, &cimniup3VBO);
-
-    glBindVertexArray(cimniup3VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cimniup3VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cimniup3Vertices), cimniup3Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    // Compile and link the shaders for the cmni
-    unsigned int cmniVertexShader, cmniFragmentShader, cmniShaderProgram;
-    cmniVertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(cmniVertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(cmniVertexShader);
-
-    glGetShaderiv(cmniVertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(cmniVertexShader, 512, NULL, infoLog);
-        std::cerr << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    cmniFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(cmniFragmentShader, 1, &cmniFragmentShaderSource, NULL);
-    glCompileShader(cmniFragmentShader);
 
-    glGetShaderiv(cmniFragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(cmniFragmentShader, 512, NULL, infoLog);
-        std::cerr << "Fragment shader compilation failed:\n" << infoLog << std::endl;
-        return -1;
-    }
-
-    cmniShaderProgram = glCreateProgram();
-    glAttachShader(cmniShaderProgram, cmniVertexShader);
-    glAttachShader(cmniShaderProgram, cmniFragmentShader);
-    glLinkProgram(cmniShaderProgram);
-    glDeleteShader(cmniVertexShader);
-    glDeleteShader(cmniFragmentShader);
-
-    glGetProgramiv(cmniShaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(cmniShaderProgram, 512, NULL, infoLog);
-        std::cerr << "Shader program linking failed:\n" << infoLog << std::endl;
-        return -1;
-    }
 
     // Define vertices for the cmni
     float cmniVertices[] = {
@@ -712,19 +329,6 @@ int main()
         0.870839997f, 0.344757f, 0.0f
     };
 
-    // Create VAO and VBO for the cmni
-    unsigned int cmniVAO, cmniVBO;
-    glGenVertexArrays(1, &cmniVAO);
-    glGenBuffers(1, &cmniVBO);
-
-    glBindVertexArray(cmniVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cmniVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cmniVertices), cmniVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
 
 
     // Define vertices for the cmni2
@@ -734,20 +338,6 @@ int main()
      0.807115145f, 0.948392626f, 0.0f
     };
 
-    // Create VAO and VBO for the cmni2
-    unsigned int cmni2VAO, cmni2VBO;
-    glGenVertexArrays(1, &cmni2VAO);
-    glGenBuffers(1, &cmni2VBO);
-
-    glBindVertexArray(cmni2VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cmni2VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cmni2Vertices), cmni2Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-
 
 
     // Define vertices for the cmni3
@@ -757,19 +347,6 @@ int main()
      0.711093596f, 0.38092578f, 0.0f
     };
 
-    // Create VAO and VBO for the cmni3
-    unsigned int cmni3VAO, cmni3VBO;
-    glGenVertexArrays(1, &cmni3VAO);
-    glGenBuffers(1, &cmni3VBO);
-
-    glBindVertexArray(cmni3VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cmni3VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cmni3Vertices), cmni3Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
 
 
     // Define vertices for the cmni4
@@ -778,167 +355,588 @@ int main()
       0.711093596f, 0.38092578f, 0.0f,
       0.711495344f,0.818429128f, 0.0f,
      0.645375309f, 0.813711461f, 0.0f
-     
+
     };
 
-    // Create VAO and VBO for the cmni4
-    unsigned int cmni4VAO, cmni4VBO;
-    glGenVertexArrays(1, &cmni4VAO);
-    glGenBuffers(1, &cmni4VBO);
 
-    glBindVertexArray(cmni4VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cmni4VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cmni4Vertices), cmni4Vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 
+    // The scene comes from --scene when given (text or binary form), otherwise it is the
+    // built-in house above. Shapes are packed into one shared vertex buffer, in draw order,
+    // so that consecutive shapes with the same color go out in a single draw call.
+    // The house is assembled here; a scene file is loaded once it is known where it goes
+    // (GPU buffers or CPU memory).
+    SceneBatch sceneBatch;
+    InstancedShape windowPanes;
+
+    // Curves are cut into as few triangles as keep them within a quarter pixel of the
+    // true outline on this framebuffer
+    TessellationSettings tessellation;
+    tessellation.pixelsPerUnitX = SCR_WIDTH / 2.0f;
+    tessellation.pixelsPerUnitY = SCR_HEIGHT / 2.0f;
+    tessellation.threadCount = options.softwareThreads;
+
+    if (options.scenePath.empty())
+    {
+        int squareColorIndex = sceneBatch.addColor(squareColor);
+        int triangleColorIndex = sceneBatch.addColor(triangleColor);
+        int triangle2ColorIndex = sceneBatch.addColor(triangle2Color);
+        int windowColorIndex = sceneBatch.addColor(windowColor);
+        int cmniColorIndex = sceneBatch.addColor(cmniColor);
+
+        sceneBatch.addShape(GL_TRIANGLE_STRIP, squareColorIndex, squareVertices);
+        sceneBatch.addShape(GL_TRIANGLES, triangleColorIndex, triangleVertices);
+        sceneBatch.addShape(GL_TRIANGLES, triangle2ColorIndex, triangle2Vertices);
+        sceneBatch.addShape(GL_TRIANGLES, triangleColorIndex, triangle3Vertices);
+        sceneBatch.addShape(GL_TRIANGLES, triangle2ColorIndex, triangle4Vertices);
+
+        // chimney
+        sceneBatch.addShape(GL_TRIANGLES, windowColorIndex, cmniVertices);
+        sceneBatch.addShape(GL_TRIANGLES, windowColorIndex, cmni2Vertices);
+        sceneBatch.addShape(GL_TRIANGLES, windowColorIndex, cmni3Vertices);
+        sceneBatch.addShape(GL_TRIANGLES, windowColorIndex, cmni4Vertices);
+
+        // chimney tops
+        sceneBatch.addShape(GL_TRIANGLES, cmniColorIndex, cimniupVertices);
+        sceneBatch.addShape(GL_TRIANGLES, cmniColorIndex, cimniup1Vertices);
+        sceneBatch.addShape(GL_TRIANGLES, cmniColorIndex, cimniup2Vertices);
+        sceneBatch.addShape(GL_TRIANGLES, cmniColorIndex, cimniup3Vertices);
+
+        sceneBatch.addShape(GL_LINES, triangle2ColorIndex, lineVertices);
+
+        // the moon, round on screen despite the wide framebuffer
+        TriangleMesh moon;
+        float moonRadius = 0.08f;
+        tessellateEllipse(-0.75f, 0.75f, moonRadius, moonRadius * SCR_WIDTH / SCR_HEIGHT, 0.0f, 6.2831853f, tessellation, moon);
+        std::vector<float> moonVertices;
+        moon.expand(moonVertices);
+        sceneBatch.addShape(GL_TRIANGLES, sceneBatch.addColor(circleColor), moonVertices.data(), (int)moonVertices.size() / 3);
+
+        // The window panes are one two-triangle pane repeated along the wall: upload the
+        // pane once and place every copy as an instance, so they cost a single draw call
+        const float* paneHalves[4][2] = {
+            { squareWindowVertices, squareWindow1Vertices },
+            { squareWindow2Vertices, squareWindow3Vertices },
+            { squareWindow4Vertices, squareWindow5Vertices },
+            { squareWindow6Vertices, squareWindow7Vertices },
+        };
+        for (int i = 0; i < 4; i++)
+        {
+            float pane[18];
+            std::copy(paneHalves[i][0], paneHalves[i][0] + 9, pane);
+            std::copy(paneHalves[i][1], paneHalves[i][1] + 9, pane + 9);
+            if (i == 0)
+                windowPanes.setTemplate(GL_TRIANGLES, pane, 6);
+
+            float offsetScale[4];
+            windowPanes.fitInstance(pane, 6, offsetScale);
+            windowPanes.addInstance(offsetScale, windowColor);
+        }
+    }
+
+    // Without a GPU the CPU rasterizer draws the frame, in the same wireframe mode as the
+    // GL path below, and the program ends here without opening a window
+    if (!options.softwarePath.empty())
+    {
+        if (!options.scenePath.empty() && !loadScene(options.scenePath.c_str(), sceneBatch, false, tessellation))
+            return -1;
+        windowPanes.expandInto(sceneBatch);
+
+        int threads = options.softwareThreads;
+        if (threads == 0)
+            threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+        SoftwareRasterizer rasterizer;
+        rasterizer.resize(SCR_WIDTH, SCR_HEIGHT);
+        rasterizer.setPolygonMode(GL_LINE);
+        rasterizer.setThreadCount(threads);
+        auto renderStart = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < options.frameCount; frame++)
+        {
+            rasterizer.clear(backgroundColor);
+            rasterizer.drawBatch(sceneBatch);
+            rasterizer.flush();
+        }
+        double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+        std::cout << "Rendered " << options.frameCount << " frames in software on " << threads << " threads in "
+            << renderMs << " ms (" << options.frameCount * 1000.0 / renderMs << " fps)" << std::endl;
+
+        std::vector<unsigned char> pixels;
+        rasterizer.readPixels(pixels);
+        if (!writePPM(options.softwarePath.c_str(), rasterizer.width, rasterizer.height, pixels.data()))
+        {
+            std::cerr << "Failed to write " << options.softwarePath << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Initialize GLFW
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialize GLFW" << std::endl;
+        return -1;
+    }
+
+    // Configure GLFW
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    if (options.headless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    // Create a GLFW window
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "OpenGL Example", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+
+    // Initialize GLAD
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cerr << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    // Headless runs draw into an offscreen framebuffer; the window only provides the context
+    OffscreenTarget offscreen;
+    if (options.headless)
+    {
+        if (!offscreen.create(SCR_WIDTH, SCR_HEIGHT))
+        {
+            std::cerr << "Failed to create offscreen framebuffer" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        offscreen.bind();
+    }
+
+    // Every part of the house uses the same vertex shader and a flat color, so one
+    // program serves the whole scene; the color is a uniform set per shape run.
+    // Linked programs are kept as driver binaries in shader_cache/, so only the first
+    // run on a machine pays for compiling and linking.
+    auto shaderStart = std::chrono::steady_clock::now();
+    ShaderCache shaderCache;
+    shaderCache.enableBinaryCache("shader_cache");
+    unsigned int flatShaderProgram = shaderCache.getProgram(vertexShaderSource, flatColorFragmentShaderSource);
+    unsigned int instancedShaderProgram = shaderCache.getProgram(instancedVertexShaderSource, instancedFragmentShaderSource);
+    unsigned int compactShaderProgram = 0;
+    if (options.compactVertices)
+        compactShaderProgram = shaderCache.getProgram(compactVertexShaderSource, vertexColorFragmentShaderSource);
+    if (flatShaderProgram == 0 || instancedShaderProgram == 0 || (options.compactVertices && compactShaderProgram == 0))
+        return -1;
+    double shaderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
+    std::cout << "Shaders ready in " << shaderMs << " ms (" << shaderCache.binaryLoads() << " loaded from binary cache, "
+        << shaderCache.programLinks() << " compiled)" << std::endl;
+    int colorLocation = glGetUniformLocation(flatShaderProgram, "color");
+    int boxLocation = options.compactVertices ? glGetUniformLocation(compactShaderProgram, "positionBox") : -1;
+
+    int rootNode = sceneGraph.addNode(-1);
+    houseNode = sceneGraph.addNode(rootNode);
+
+    // The programs read world transforms from texture unit 0; everything drawn with
+    // them belongs to the house node
+    unsigned int graphPrograms[] = { flatShaderProgram, instancedShaderProgram, compactShaderProgram };
+    for (unsigned int program : graphPrograms)
+    {
+        if (program == 0)
+            continue;
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "worldMatrices"), 0);
+        glUniform1i(glGetUniformLocation(program, "node"), houseNode);
+    }
+
+    // Binary scene files are loaded straight into GPU buffers and drawn as they are. Text
+    // scenes and the built-in house are welded into an indexed copy, reordered for the
+    // vertex cache, and drawn from that, or with --compact converted to the compact
+    // vertex format.
+    IndexedBatch indexedBatch;
+    CompactBatch compactBatch;
+    if (!options.scenePath.empty())
+    {
+        auto loadStart = std::chrono::steady_clock::now();
+        if (!loadScene(options.scenePath.c_str(), sceneBatch, isBinaryScene(options.scenePath.c_str()), tessellation))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+        std::cout << "Loaded " << options.scenePath << ": " << sceneBatch.shapeCount() << " shapes in " << loadMs << " ms" << std::endl;
+    }
+    else
+        windowPanes.upload();
+    if (!sceneBatch.vertices().empty() && options.compactVertices)
+    {
+        compactBatch.build(sceneBatch);
+        compactBatch.upload();
+        std::cout << "Compact vertices: " << compactBatch.vertexCount() << " vertices in " << compactBatch.vertexBytes()
+            << " bytes instead of " << compactBatch.sourceBytes() << " (" << (double)compactBatch.sourceBytes() / compactBatch.vertexBytes()
+            << "x smaller), " << compactBatch.rangeCount() << " ranges, largest position error "
+            << compactBatch.maxError * SCR_WIDTH / 2.0f << " px" << std::endl;
+    }
+    else if (!sceneBatch.vertices().empty())
+    {
+        indexedBatch.build(sceneBatch);
+        indexedBatch.upload();
+        const IndexStats& stats = indexedBatch.stats;
+        std::cout << "Indexed " << stats.unindexedVertices << " vertices into " << stats.weldedVertices << " unique ones and "
+            << stats.indexCount << " indices (" << stats.unindexedBytes << " -> " << stats.indexedBytes << " bytes), ACMR "
+            << stats.missRatioUnindexed << " unindexed, " << stats.missRatioWelded << " welded, "
+            << stats.missRatioOptimized << " reordered" << std::endl;
+    }
+
+    // Save the scene in the binary form for fast loading, with the instanced panes turned
+    // back into plain shapes. A scene that was itself loaded from a binary file keeps no
+    // vertex copy and is already in that form.
+    if (!options.writeScenePath.empty())
+    {
+        SceneBatch scene;
+        scene.append(sceneBatch);
+        windowPanes.expandInto(scene);
+        if (sceneBatch.vertices().empty() || !writeSceneBinary(options.writeScenePath.c_str(), scene))
+            std::cerr << "Failed to write " << options.writeScenePath << std::endl;
+    }
 
 
    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // Recording reads frames back through a ring of PBOs so the loop never waits on the GPU
+    FrameCapture frameCapture;
+    if (!options.captureDirectory.empty())
+    {
+        int captureWidth = SCR_WIDTH, captureHeight = SCR_HEIGHT;
+        if (!options.headless)
+            glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+        frameCapture.start(options.captureDirectory.c_str(), captureWidth, captureHeight);
+    }
+
+    // Optional per-frame timings of input, transforms, drawing and presenting
+    FrameProfiler profiler;
+    FrameProfiler* activeProfiler = NULL;
+    int inputSection = 0, transformSection = 0, drawSection = 0, swapSection = 0;
+    if (!options.profilePath.empty())
+    {
+        activeProfiler = &profiler;
+        inputSection = profiler.addSection("input", false);
+        transformSection = profiler.addSection("transforms", false);
+        drawSection = profiler.addSection("draw", true);
+        swapSection = profiler.addSection("swap", false);
+    }
+
+    // Damage tracking needs a frame that keeps its pixels between redraws, which a
+    // swapped back buffer does not promise: in a window, frames are drawn into a canvas
+    // that is then copied to the back buffer. Headless runs already draw offscreen.
+    OffscreenTarget canvas;
+    bool useCanvas = options.damageRegions && !options.headless;
+
+    // The scene's bounds, for turning a move of the house into a damaged rectangle; a
+    // binary scene keeps no vertices on the CPU, so moving it damages everything
+    float houseBounds[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const std::vector<float>& houseVertices = sceneBatch.vertices();
+    bool houseBoundsKnown = !houseVertices.empty();
+    for (size_t i = 0; i < houseVertices.size(); i += 3)
+    {
+        houseBounds[0] = i == 0 ? houseVertices[i] : std::min(houseBounds[0], houseVertices[i]);
+        houseBounds[1] = i == 0 ? houseVertices[i + 1] : std::min(houseBounds[1], houseVertices[i + 1]);
+        houseBounds[2] = i == 0 ? houseVertices[i] : std::max(houseBounds[2], houseVertices[i]);
+        houseBounds[3] = i == 0 ? houseVertices[i + 1] : std::max(houseBounds[3], houseVertices[i + 1]);
+    }
+    // The drawn batch's ranges are filed by their bounds in a spatial grid, so each
+    // frame only the ones that overlap the screen are drawn
+    SpatialGrid rangeGrid;
+    int drawRangeCount = options.compactVertices ? compactBatch.rangeCount() : indexedBatch.rangeCount();
+    if (houseBoundsKnown && drawRangeCount > 0)
+    {
+        int columns, rows;
+        SpatialGrid::suggestCells(houseBounds, drawRangeCount, columns, rows);
+        rangeGrid.reset(houseBounds, columns, rows);
+        for (int i = 0; i < drawRangeCount; i++)
+        {
+            float box[4];
+            if (options.compactVertices)
+                compactBatch.rangeBounds(i, box);
+            else
+                indexedBatch.rangeBounds(i, box);
+            rangeGrid.insert(box);
+        }
+    }
+
+    sceneGraph.update();
+    sceneGraph.upload();
+    int houseRect[4] = { 0, 0, 0, 0 };
+    int targetWidth = SCR_WIDTH, targetHeight = SCR_HEIGHT;
+    if (!options.headless)
+        glfwGetFramebufferSize(window, &targetWidth, &targetHeight);
+    screenRect(sceneGraph.world(houseNode), houseBounds, targetWidth, targetHeight, houseRect);
+
+    // The CPU side of a frame: apply the input, propagate the scene graph, place the
+    // house on screen and cull what is off screen, and fill a sorted render queue with
+    // the house in layer 0 and the window panes (one instanced call for all of them) on
+    // top in layer 1. It touches no GL state, so it can run on another thread.
+    auto prepareFrame = [&](PreparedFrame& prepared, int keys, int width, int height)
+    {
+        prepared.moved = applyInput(keys);
+        prepared.transformsChanged = sceneGraph.update();
+        if (prepared.transformsChanged)
+            prepared.worldRows = sceneGraph.worldRows();
+
+        std::copy(houseRect, houseRect + 4, prepared.oldRect);
+        screenRect(sceneGraph.world(houseNode), houseBounds, width, height, houseRect);
+        std::copy(houseRect, houseRect + 4, prepared.newRect);
+        prepared.culled = houseBoundsKnown
+            && (houseRect[2] <= 0 || houseRect[0] >= width || houseRect[3] <= 0 || houseRect[1] >= height);
+
+        // The screen, taken back into the house's own coordinates, is the view the
+        // range grid is asked about
+        prepared.visibleRanges.clear();
+        if (!prepared.culled && rangeGrid.itemCount() > 0)
+        {
+            glm::mat4 screenToHouse = glm::inverse(sceneGraph.world(houseNode));
+            float view[4] = { 1e30f, 1e30f, -1e30f, -1e30f };
+            for (int corner = 0; corner < 4; corner++)
+            {
+                glm::vec4 p = screenToHouse * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, 0.0f, 1.0f);
+                view[0] = std::min(view[0], p.x);
+                view[1] = std::min(view[1], p.y);
+                view[2] = std::max(view[2], p.x);
+                view[3] = std::max(view[3], p.y);
+            }
+            rangeGrid.query(view, prepared.visibleRanges);
+        }
+        prepared.culledRanges = drawRangeCount - (int)prepared.visibleRanges.size();
+
+        prepared.queue.clear();
+        if (!prepared.culled)
+        {
+            if (compactBatch.rangeCount() > 0)
+                compactBatch.submit(prepared.queue, 0, compactShaderProgram, boxLocation, prepared.visibleRanges);
+            else if (rangeGrid.itemCount() > 0)
+                indexedBatch.submit(prepared.queue, 0, flatShaderProgram, colorLocation, prepared.visibleRanges);
+            else if (indexedBatch.rangeCount() > 0)
+                indexedBatch.submit(prepared.queue, 0, flatShaderProgram, colorLocation);
+            else
+                sceneBatch.submit(prepared.queue, 0, flatShaderProgram, colorLocation);
+            windowPanes.submit(prepared.queue, 1, instancedShaderProgram);
+        }
+        prepared.queue.sort();
+    };
+
+    // With --threaded a worker prepares frame N+1 while this thread, which owns the GL
+    // context and the window, draws frame N. Input is still read here, where GLFW needs
+    // it, and reaches the worker through atomics.
+    PreparedFrame inlineFrame;
+    FramePipeline<PreparedFrame> pipeline;
+    std::atomic<int> sharedKeys(0), sharedWidth(targetWidth), sharedHeight(targetHeight);
+    if (options.threaded)
+    {
+        pipeline.start([&](PreparedFrame& prepared, long long /*index*/)
+        {
+            prepareFrame(prepared, sharedKeys.load(), sharedWidth.load(), sharedHeight.load());
+        });
+    }
+
+    // Queued draws are executed through a cache of the bound GL state
+    GLStateCache glState;
+    long long queuedPackets = 0;
+    long long culledFrames = 0;
+    long long drawnRanges = 0, culledRanges = 0;
+
     // Render loop
+    int frame = 0;
+    auto renderStart = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(window))
     {
-        processInput(window);
-
-        // Clear the screen
-        glClearColor(0.2f, 1.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // Draw the square
-        glUseProgram(squareShaderProgram);
-        glBindVertexArray(squareVAO);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-        // Draw the square
-       // glUseProgram(UpperVertexShader);
-       // glBindVertexArray(UpperVAO);
-       // glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-        // Draw the triangle
-        glUseProgram(triangleShaderProgram);
-        glBindVertexArray(triangleVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the triangle
-        glUseProgram(triangle2ShaderProgram);
-        glBindVertexArray(triangle2VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-
-        // Draw the triangle
-        glUseProgram(triangleShaderProgram);
-        glBindVertexArray(triangle3VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the triangle
-       glUseProgram(triangle2ShaderProgram);
-        glBindVertexArray(triangle4VAO);
-       glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cmni1
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(cmniVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cmni2
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(cmni2VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cmni3
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(cmni3VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cmni4
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(cmni4VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindowVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow1VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow2VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow3VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow4VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow5VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow6VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-        glUseProgram(windowShaderProgram);
-        glBindVertexArray(squareWindow7VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cimniup
-        glUseProgram(cmniShaderProgram);
-        glBindVertexArray(cimniupVAO);  // Draw the window
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cimniup1
-        glUseProgram(cmniShaderProgram);
-        glBindVertexArray(cimniup1VAO);  // Draw the window
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the cimniup1
-        glUseProgram(cmniShaderProgram);
-        glBindVertexArray(cimniup2VAO);  // Draw the window
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        glUseProgram(cmniShaderProgram);
-        glBindVertexArray(cimniup3VAO);  // Draw the window
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        // Draw the window
-       glUseProgram(triangle2ShaderProgram);
-        glBindVertexArray(lineVAO);
-        glDrawArrays(GL_LINE, 0, 2);
-
-        /*
-        // Draw the cmni4
-        glUseProgram(circleShaderProgram);
-        glBindVertexArray(circleVAO);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 25);
-        */
-
-        // Swap buffers and poll events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (activeProfiler)
+            activeProfiler->beginFrame();
+
+        int keys;
+        {
+            ProfileScope scope(activeProfiler, inputSection);
+            keys = sampleInput(window);
+        }
+        if (!options.headless)
+            glfwGetFramebufferSize(window, &targetWidth, &targetHeight);
+
+        // Get the frame's transforms and draws, prepared here or taken from the worker,
+        // and send all world transforms in one buffer write
+        PreparedFrame* prepared = &inlineFrame;
+        {
+            ProfileScope scope(activeProfiler, transformSection);
+            if (options.threaded)
+            {
+                sharedKeys.store(keys);
+                sharedWidth.store(targetWidth);
+                sharedHeight.store(targetHeight);
+                prepared = pipeline.acquire();
+                if (!prepared)
+                    break;
+            }
+            else
+                prepareFrame(inlineFrame, keys, targetWidth, targetHeight);
+            if (prepared->transformsChanged)
+                sceneGraph.upload(prepared->worldRows);
+        }
+        bool moved = prepared->moved;
+        if (prepared->culled)
+            culledFrames++;
+        culledRanges += prepared->culledRanges;
+        drawnRanges += drawRangeCount - prepared->culledRanges;
+
+        // A moved house damages where it was and where it is now
+        if (moved)
+        {
+            if (houseBoundsKnown)
+            {
+                redraw.mark(prepared->oldRect[0], prepared->oldRect[1], prepared->oldRect[2], prepared->oldRect[3]);
+                redraw.mark(prepared->newRect[0], prepared->newRect[1], prepared->newRect[2], prepared->newRect[3]);
+            }
+            else
+                redraw.markAll();
+        }
+
+        bool drawFrame = !options.renderOnDemand || redraw.dirty();
+        if (!drawFrame)
+            redraw.skipped();
+        else
+        {
+            ProfileScope scope(activeProfiler, drawSection);
+
+            if (useCanvas)
+            {
+                if (canvas.width != targetWidth || canvas.height != targetHeight)
+                {
+                    canvas.destroy();
+                    canvas.create(targetWidth, targetHeight);
+                    redraw.markAll();
+                }
+                canvas.bind();
+            }
+            if (options.damageRegions)
+                redraw.beginScissor(targetWidth, targetHeight);
+
+            // Clear the screen
+            glClearColor(backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3]);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // Draw the queue in key order; the state cache drops binds and color uploads
+            // that would not change anything
+            sceneGraph.bind(0);
+            prepared->queue.execute(glState);
+            queuedPackets += prepared->queue.packetCount();
+
+            if (options.damageRegions)
+                redraw.endScissor();
+            if (useCanvas)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, canvas.FBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                glBlitFramebuffer(0, 0, targetWidth, targetHeight, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            }
+            redraw.rendered();
+        }
+
+        // The frame's commands are issued; the worker may refill its slot
+        if (options.threaded)
+            pipeline.release();
+
+        if (drawFrame && !options.captureDirectory.empty())
+            frameCapture.capture();
+
+        // Swap buffers and poll events; headless runs have nothing to present. On demand,
+        // with nothing moving or about to move, sleep until an event arrives instead of
+        // spinning.
+        {
+            ProfileScope scope(activeProfiler, swapSection);
+            if (!options.headless && drawFrame)
+                glfwSwapBuffers(window);
+            if (options.renderOnDemand && !options.headless && !moved && keys == 0)
+                glfwWaitEvents();
+            else
+                glfwPollEvents();
+        }
+
+        if (activeProfiler)
+            activeProfiler->endFrame();
+
+        frame++;
+        if (options.headless && frame >= options.frameCount)
+            break;
+    }
+    pipeline.stop();
+
+    if (options.threaded)
+    {
+        std::cout << "Threaded: the worker waited for the GL thread in " << pipeline.producerWaits()
+            << " frames, the GL thread waited for the worker in " << pipeline.consumerWaits() << std::endl;
+    }
+    if (culledFrames > 0)
+        std::cout << "Culled the off-screen house in " << culledFrames << " frames" << std::endl;
+    if (frame > 0 && drawRangeCount > 0)
+    {
+        std::cout << "Viewport culling: " << (double)drawnRanges / frame << " ranges drawn and " << (double)culledRanges / frame
+            << " culled per frame, of " << drawRangeCount << std::endl;
+    }
+
+    if (redraw.framesRendered() > 0)
+    {
+        int drawn = redraw.framesRendered();
+        std::cout << "Render queue: " << (double)queuedPackets / drawn << " packets, " << (double)glState.issued() / drawn
+            << " state changes issued and " << (double)glState.avoided() / drawn << " avoided per frame" << std::endl;
+    }
+
+    if (options.renderOnDemand)
+    {
+        std::cout << "On demand: rendered " << redraw.framesRendered() << " frames, skipped " << redraw.framesSkipped()
+            << " with nothing to redraw";
+        if (options.damageRegions)
+            std::cout << "; " << redraw.partialFrames() << " redrew only their damage (" << redraw.damagedPixels() << " pixels)";
+        std::cout << std::endl;
+    }
+
+    if (activeProfiler)
+    {
+        profiler.finish();
+        profiler.report(std::cout);
+        if (!profiler.write(options.profilePath))
+            std::cerr << "Failed to write " << options.profilePath << std::endl;
+    }
+
+    if (!options.captureDirectory.empty())
+    {
+        frameCapture.finish();
+        std::cout << "Captured " << frameCapture.framesWritten() << " frames to " << options.captureDirectory << std::endl;
+    }
+
+    if (options.headless)
+    {
+        std::vector<unsigned char> pixels;
+        offscreen.readPixels(pixels);
+        double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+        std::cout << "Rendered " << frame << " frames in " << renderMs << " ms (" << frame * 1000.0 / renderMs << " fps)" << std::endl;
+
+        if (!writePPM(options.outputPath.c_str(), offscreen.width, offscreen.height, pixels.data()))
+            std::cerr << "Failed to write " << options.outputPath << std::endl;
+        offscreen.destroy();
     }
 
     // Cleanup and exit
-    glDeleteVertexArrays(1, &squareVAO);
-    glDeleteBuffers(1, &squareVBO);
-    glDeleteVertexArrays(1, &triangleVAO);
-    glDeleteBuffers(1, &triangleVBO);
+    sceneBatch.destroy();
+    indexedBatch.destroy();
+    compactBatch.destroy();
+    canvas.destroy();
+    windowPanes.destroy();
+    sceneGraph.destroy();
+    shaderCache.destroy();
+
+    // every buffer, vertex array and program above is back in the pool by now, so
+    // anything the report still counts as live was leaked
+    GLObjectPool::shared().report(std::cout);
+    GLObjectPool::shared().trim();
 
     glfwTerminate();
     return 0;
@@ -948,10 +946,65 @@ int main()
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    redraw.markAll();
+}
+
+// The window was uncovered or needs repainting for some other reason
+void window_refresh_callback(GLFWwindow* window)
+{
+    redraw.markAll();
 }
 
-void processInput(GLFWwindow* window)
+// Handles Escape and returns the arrow keys held; GLFW must be asked on the main thread
+int sampleInput(GLFWwindow* window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-} 
\ No newline at end of file
+
+    int keys = 0;
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        keys |= KeyLeft;
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        keys |= KeyRight;
+    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+        keys |= KeyUp;
+    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+        keys |= KeyDown;
+    return keys;
+}
+
+// Arrow keys move the whole house; returns whether it moved
+bool applyInput(int keys)
+{
+    Transform2D& house = sceneGraph.local(houseNode);
+    unsigned int version = house.version();
+    if (keys & KeyLeft)
+        house.translate(-0.01f, 0.0f);
+    if (keys & KeyRight)
+        house.translate(0.01f, 0.0f);
+    if (keys & KeyUp)
+        house.translate(0.0f, 0.01f);
+    if (keys & KeyDown)
+        house.translate(0.0f, -0.01f);
+    return house.version() != version;
+}
+
+// Pixel rectangle (minX, minY, maxX, maxY) of a width x height target that covers the
+// box bounds (minX, minY, maxX, maxY) once placed by world, with a margin for lines
+void screenRect(const glm::mat4& world, const float* bounds, int width, int height, int rect[4])
+{
+    const int margin = 2;
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    for (int corner = 0; corner < 4; corner++)
+    {
+        glm::vec4 p = world * glm::vec4(bounds[corner & 1 ? 2 : 0], bounds[corner & 2 ? 3 : 1], 0.0f, 1.0f);
+        minX = std::min(minX, p.x);
+        minY = std::min(minY, p.y);
+        maxX = std::max(maxX, p.x);
+        maxY = std::max(maxY, p.y);
+    }
+    rect[0] = (int)std::floor((minX + 1.0f) * 0.5f * width) - margin;
+    rect[1] = (int)std::floor((minY + 1.0f) * 0.5f * height) - margin;
+    rect[2] = (int)std::ceil((maxX + 1.0f) * 0.5f * width) + margin;
+    rect[3] = (int)std::ceil((maxY + 1.0f) * 0.5f * height) + margin;
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gl_objects.h"
+#include "render_queue.h"
+#include "scene_batch.h"
+
+// Attributes of an interleaved vertex, in order, with the offsets and stride worked out
+// from their types. apply() turns the description into glVertexAttribPointer calls for
+// the bound VAO and array buffer.
+class VertexLayout
+{
+public:
+    struct Attribute
+    {
+        GLuint location;
+        GLint components;
+        GLenum type;
+        GLboolean normalized;   // integers read as [0, 1] (unsigned) or [-1, 1] (signed)
+        size_t offset;
+    };
+
+    VertexLayout& add(GLuint location, GLint components, GLenum type, bool normalized = false)
+    {
+        Attribute attribute = { location, components, type, (GLboolean)(normalized ? GL_TRUE : GL_FALSE), stride_ };
+        attributes_.push_back(attribute);
+        stride_ += components * typeSize(type);
+        return *this;
+    }
+
+    void apply() const
+    {
+        for (const Attribute& attribute : attributes_)
+        {
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                (GLsizei)stride_, (void*)attribute.offset);
+            glEnableVertexAttribArray(attribute.location);
+        }
+    }
+
+    size_t stride() const { return stride_; }
+    const std::vector<Attribute>& attributes() const { return attributes_; }
+
+    static size_t typeSize(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+private:
+    std::vector<Attribute> attributes_;
+    size_t stride_ = 0;
+};
+
+// 8-byte vertex: a 2D position quantized to 16 bits per axis within its range's bounding
+// box, and an RGBA8 color
+struct CompactVertex
+{
+    uint16_t x, y;
+    uint8_t color[4];
+};
+
+static_assert(sizeof(CompactVertex) == 8, "CompactVertex must stay tightly packed");
+
+// Consecutive shapes with the same primitive mode, drawn with one call. box is the
+// range's bounding box as (minX, minY, width, height); positions are fractions of it.
+struct CompactRange
+{
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+    float box[4];
+};
+
+// A scene batch in a compact vertex format: 8 bytes a vertex instead of 12 for the x, y,
+// z floats of SceneBatch (z is always 0 in these scenes), with the color carried by the
+// vertex instead of a uniform set per shape.
+//
+// Positions are unsigned normalized 16-bit values relative to the bounding box of their
+// range, which the vertex shader gets as a vec4 uniform and applies:
+//
+//     layout (location = 0) in vec2 aPos;     // [0, 1] within the box
+//     layout (location = 1) in vec4 aColor;
+//     uniform vec4 positionBox;               // minX, minY, width, height
+//     vec2 p = positionBox.xy + aPos * positionBox.zw;
+//
+// Since the color is per vertex, neighbouring list shapes (triangles, lines, points)
+// share a range whatever their colors, until the range's box would grow past
+// maxRangeSize on either axis; this bounds the quantization step to maxRangeSize / 65535.
+// Strips, fans and loops are a range each.
+class CompactBatch
+{
+public:
+    static const VertexLayout& layout()
+    {
+        static const VertexLayout compact = VertexLayout()
+            .add(0, 2, GL_UNSIGNED_SHORT, true)
+            .add(1, 4, GL_UNSIGNED_BYTE, true);
+        return compact;
+    }
+
+    // Build from a batch that keeps its vertices (not a mapped binary scene)
+    void build(const SceneBatch& batch, float maxRangeSize = 0.5f)
+    {
+        vertices_.clear();
+        ranges_.clear();
+        maxError = 0.0f;
+
+        // group shapes into ranges by their bounding boxes first
+        const std::vector<float>& source = batch.vertices();
+        std::vector<float> bounds;     // minX, minY, maxX, maxY per range
+        std::vector<int> rangeOfShape;
+        for (const BatchShape& shape : batch.shapes())
+        {
+            float box[4] = { 1e30f, 1e30f, -1e30f, -1e30f };
+            for (GLsizei i = 0; i < shape.count; i++)
+            {
+                const float* vertex = &source[(shape.first + i) * 3];
+                box[0] = std::min(box[0], vertex[0]);
+                box[1] = std::min(box[1], vertex[1]);
+                box[2] = std::max(box[2], vertex[0]);
+                box[3] = std::max(box[3], vertex[1]);
+            }
+
+            bool mergeable = shape.mode == GL_TRIANGLES || shape.mode == GL_LINES || shape.mode == GL_POINTS;
+            if (!ranges_.empty() && mergeable && ranges_.back().mode == shape.mode)
+            {
+                float* last = &bounds[bounds.size() - 4];
+                float merged[4] = { std::min(last[0], box[0]), std::min(last[1], box[1]),
+                    std::max(last[2], box[2]), std::max(last[3], box[3]) };
+                if (merged[2] - merged[0] <= maxRangeSize && merged[3] - merged[1] <= maxRangeSize)
+                {
+                    std::copy(merged, merged + 4, last);
+                    ranges_.back().count += shape.count;
+                    rangeOfShape.push_back((int)ranges_.size() - 1);
+                    continue;
+                }
+            }
+            CompactRange range = { shape.mode, ranges_.empty() ? 0 : ranges_.back().first + ranges_.back().count,
+                shape.count, { 0.0f, 0.0f, 0.0f, 0.0f } };
+            ranges_.push_back(range);
+            bounds.insert(bounds.end(), box, box + 4);
+            rangeOfShape.push_back((int)ranges_.size() - 1);
+        }
+        for (size_t i = 0; i < ranges_.size(); i++)
+        {
+            float* box = ranges_[i].box;
+            box[0] = bounds[i * 4];
+            box[1] = bounds[i * 4 + 1];
+            box[2] = bounds[i * 4 + 2] - bounds[i * 4];
+            box[3] = bounds[i * 4 + 3] - bounds[i * 4 + 1];
+        }
+
+        // then quantize every vertex against its range's box
+        const std::vector<float>& colors = batch.colors();
+        vertices_.reserve(source.size() / 3);
+        for (size_t s = 0; s < batch.shapes().size(); s++)
+        {
+            const BatchShape& shape = batch.shapes()[s];
+            const float* box = ranges_[rangeOfShape[s]].box;
+            CompactVertex vertex;
+            for (int c = 0; c < 4; c++)
+                vertex.color[c] = (uint8_t)std::lround(std::min(std::max(colors[shape.color * 4 + c], 0.0f), 1.0f) * 255.0f);
+            for (GLsizei i = 0; i < shape.count; i++)
+            {
+                const float* position = &source[(shape.first + i) * 3];
+                vertex.x = quantize(position[0], box[0], box[2]);
+                vertex.y = quantize(position[1], box[1], box[3]);
+                vertices_.push_back(vertex);
+
+                float x = box[0] + vertex.x / 65535.0f * box[2];
+                float y = box[1] + vertex.y / 65535.0f * box[3];
+                maxError = std::max(maxError, std::max(std::fabs(x - position[0]), std::fabs(y - position[1])));
+            }
+        }
+        sourceBytes_ = source.size() * sizeof(float);
+    }
+
+    void upload()
+    {
+        VAO.create();
+        glBindVertexArray(VAO);
+        VBO.data(GL_ARRAY_BUFFER, vertices_.size() * sizeof(CompactVertex), vertices_.data(), GL_STATIC_DRAW);
+        layout().apply();
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // Queue every range as a draw packet of layer, with its box as the packet's vec4
+    // uniform at boxLocation; depth keeps range order
+    void submit(RenderQueue& queue, unsigned int layer, unsigned int program, GLint boxLocation) const
+    {
+        for (size_t i = 0; i < ranges_.size(); i++)
+            submitRange(queue, layer, program, boxLocation, (int)i);
+    }
+
+    // Queue only the listed ranges, e.g. the ones a culling pass found visible
+    void submit(RenderQueue& queue, unsigned int layer, unsigned int program, GLint boxLocation,
+        const std::vector<int>& visibleRanges) const
+    {
+        for (int i : visibleRanges)
+            submitRange(queue, layer, program, boxLocation, i);
+    }
+
+    // Bounding box (minX, minY, maxX, maxY) of a range
+    void rangeBounds(int index, float* bounds) const
+    {
+        const float* box = ranges_[index].box;
+        bounds[0] = box[0];
+        bounds[1] = box[1];
+        bounds[2] = box[0] + box[2];
+        bounds[3] = box[1] + box[3];
+    }
+
+    void destroy()
+    {
+        VAO.reset();
+        VBO.reset();
+    }
+
+    int rangeCount() const { return (int)ranges_.size(); }
+    size_t vertexCount() const { return vertices_.size(); }
+    const std::vector<CompactRange>& ranges() const { return ranges_; }
+
+    // Vertex memory in this format and as the x, y, z floats it was built from
+    size_t vertexBytes() const { return vertices_.size() * sizeof(CompactVertex); }
+    size_t sourceBytes() const { return sourceBytes_; }
+
+    // Largest distance of a quantized position from the original, per axis
+    float maxError = 0.0f;
+
+    GLVertexArray VAO;
+    GLBuffer VBO;
+
+private:
+    static uint16_t quantize(float value, float min, float size)
+    {
+        if (size <= 0.0f)
+            return 0;
+        float t = std::min(std::max((value - min) / size, 0.0f), 1.0f);
+        return (uint16_t)std::lround(t * 65535.0f);
+    }
+
+    void submitRange(RenderQueue& queue, unsigned int layer, unsigned int program, GLint boxLocation, int index) const
+    {
+        const CompactRange& range = ranges_[index];
+        queue.submit(layer, (unsigned int)index, program, VAO, range.mode, range.first, range.count, 0, boxLocation, range.box);
+    }
+
+    std::vector<CompactVertex> vertices_;
+    std::vector<CompactRange> ranges_;
+    size_t sourceBytes_ = 0;
+};